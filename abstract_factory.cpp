@@ -1,5 +1,6 @@
 #include <iostream>
 #include <memory>
+#include <vector>
 
 using namespace std;
 
@@ -75,6 +76,56 @@ public:
     }
 };
 
+// ========== Product Batches ==========
+// Many products of one concrete type from a single factory call, stored by
+// value in one vector. Painting or rendering the batch is one virtual call;
+// inside it each item is exactly the stored type, so the calls name it and
+// are direct.
+
+class ButtonBatch {
+public:
+    virtual size_t size() const = 0;
+    virtual Button& operator[](size_t i) = 0;
+    virtual void paintAll() = 0;
+    virtual ~ButtonBatch() {}
+};
+
+class CheckBoxBatch {
+public:
+    virtual size_t size() const = 0;
+    virtual CheckBox& operator[](size_t i) = 0;
+    virtual void renderAll() = 0;
+    virtual ~CheckBoxBatch() {}
+};
+
+template<typename T>
+class ButtonsOf final : public ButtonBatch {
+    vector<T> items;
+public:
+    explicit ButtonsOf(size_t count) : items(count) {}
+    size_t size() const override { return items.size(); }
+    T& operator[](size_t i) override { return items[i]; }
+    void paintAll() override {
+        for (T& button : items) {
+            button.T::paint();
+        }
+    }
+};
+
+template<typename T>
+class CheckBoxesOf final : public CheckBoxBatch {
+    vector<T> items;
+public:
+    explicit CheckBoxesOf(size_t count) : items(count) {}
+    size_t size() const override { return items.size(); }
+    T& operator[](size_t i) override { return items[i]; }
+    void renderAll() override {
+        for (T& checkbox : items) {
+            checkbox.T::render();
+        }
+    }
+};
+
 // ========== Abstract Factory ==========
 
 class GUIFactory {
@@ -82,6 +133,9 @@ public:
     // Factory methods to create abstract products
     virtual std::unique_ptr<Button> createButton() const = 0;
     virtual std::unique_ptr<CheckBox> createCheckBox() const = 0;
+    // Bulk versions: `count` products of the family in one batch
+    virtual std::unique_ptr<ButtonBatch> createButtons(size_t count) const = 0;
+    virtual std::unique_ptr<CheckBoxBatch> createCheckBoxes(size_t count) const = 0;
     virtual ~GUIFactory() = default;
 };
 
@@ -96,6 +150,14 @@ public:
     std::unique_ptr<CheckBox> createCheckBox() const override {
         return std::make_unique<WindowsCheckBox>();
     }
+
+    std::unique_ptr<ButtonBatch> createButtons(size_t count) const override {
+        return std::make_unique<ButtonsOf<WindowsButton>>(count);
+    }
+
+    std::unique_ptr<CheckBoxBatch> createCheckBoxes(size_t count) const override {
+        return std::make_unique<CheckBoxesOf<WindowsCheckBox>>(count);
+    }
 };
 
 class MacFactory : public GUIFactory {
@@ -107,6 +169,14 @@ public:
     std::unique_ptr<CheckBox> createCheckBox() const override {
         return std::make_unique<MacCheckBox>();
     }
+
+    std::unique_ptr<ButtonBatch> createButtons(size_t count) const override {
+        return std::make_unique<ButtonsOf<MacButton>>(count);
+    }
+
+    std::unique_ptr<CheckBoxBatch> createCheckBoxes(size_t count) const override {
+        return std::make_unique<CheckBoxesOf<MacCheckBox>>(count);
+    }
 };
 
 // ========== Platform Enum ==========
@@ -139,6 +209,15 @@ void renderUI(const GUIFactory& factory) {
     checkbox->render();  // Use the product without knowing its exact type
 }
 
+// Renders `count` of each control, e.g. a form with many rows.
+void renderUI(const GUIFactory& factory, size_t count) {
+    auto buttons = factory.createButtons(count);       // One batch, one allocation
+    auto checkboxes = factory.createCheckBoxes(count);
+
+    buttons->paintAll();      // One virtual call for the whole batch
+    checkboxes->renderAll();
+}
+
 // ========== Main Function ==========
 // Demonstrates using the abstract factory to switch between platforms.
 
@@ -153,5 +232,8 @@ int main() {
     factory = createFactory(platform);
     renderUI(*factory);
 
+    // Render a form with two rows of controls in bulk
+    renderUI(*factory, 2);
+
     return 0;
 }
@@ -16,35 +16,638 @@
 
 #include<iostream>
 #include<vector>
+#include<memory>
+#include<string>
+#include<string_view>
+#include<unordered_set>
+#include<cstdint>
+#include<algorithm>
+#include<atomic>
+#include<deque>
+#include<functional>
+#include<mutex>
+#include<condition_variable>
+#include<thread>
+#include<system_error>
+#include<stdexcept>
+#include<exception>
+#include<utility>
+#include<cerrno>
+#include<unistd.h>
+
+// Names stored back to back in one buffer. Identical names are interned,
+// so a million "index.js" files cost one copy of the string.
+class StringArena {
+        struct Ref {
+            std::uint32_t offset;
+            std::uint32_t length;
+        };
+        struct RefHash {
+            const std::string* data;
+            std::size_t operator()(const Ref& r) const {
+                return std::hash<std::string_view>()(std::string_view(data->data() + r.offset, r.length));
+            }
+        };
+        struct RefEqual {
+            const std::string* data;
+            bool operator()(const Ref& a, const Ref& b) const {
+                return std::string_view(data->data() + a.offset, a.length) ==
+                    std::string_view(data->data() + b.offset, b.length);
+            }
+        };
+
+        std::string data;
+        std::unordered_set<Ref, RefHash, RefEqual> interned{16, RefHash{&data}, RefEqual{&data}};
+
+    public:
+        StringArena() = default;
+        StringArena(const StringArena&) = delete;
+        StringArena& operator=(const StringArena&) = delete;
+
+        // Returns the offset of the name, appending it only if it is new.
+        std::uint32_t intern(std::string_view s) {
+            Ref candidate{std::uint32_t(data.size()), std::uint32_t(s.size())};
+            data.append(s);
+            auto it = interned.find(candidate);
+            if (it != interned.end()) {
+                data.resize(candidate.offset);
+                return it->offset;
+            }
+            interned.insert(candidate);
+            return candidate.offset;
+        }
+
+        std::string_view view(std::uint32_t offset, std::uint32_t length) const {
+            return std::string_view(data.data() + offset, length);
+        }
+
+        std::size_t bytes() const { return data.size(); }
+};
+
+// Destination for rendered output.
+class OutputSink {
+    public:
+        virtual void write(const char* data, std::size_t size) = 0;
+        virtual ~OutputSink() = default;
+};
+
+class FdSink : public OutputSink {
+        int fd;
+    public:
+        explicit FdSink(int fd) : fd(fd) {}
+        void write(const char* data, std::size_t size) override {
+            while (size > 0) {
+                ssize_t n = ::write(fd, data, size);
+                if (n < 0 && errno == EINTR) continue;
+                if (n < 0) throw std::system_error(errno, std::generic_category(), "write");
+                data += n;
+                size -= std::size_t(n);
+            }
+        }
+};
+
+class OstreamSink : public OutputSink {
+        std::ostream& out;
+    public:
+        explicit OstreamSink(std::ostream& o) : out(o) {}
+        void write(const char* data, std::size_t size) override {
+            out.write(data, std::streamsize(size));
+            out.flush();
+        }
+};
+
+// Reusable output buffer. Lines are appended in place and handed to the
+// sink in large chunks; without a sink it keeps the chunks, which is how
+// subtrees are rendered in parallel. Appending one buffer to another moves
+// its chunks over (or writes them to the sink), so rendered text is copied
+// once however deep the buffer it lands in.
+class RenderBuffer {
+        std::string buf;
+        std::vector<std::string> sealed; // full chunks, when there is no sink
+        OutputSink* sink;
+        std::size_t chunk;
+
+        void seal() {
+            if (!buf.empty()) {
+                sealed.push_back(std::move(buf));
+                buf = std::string();
+            }
+        }
+    public:
+        explicit RenderBuffer(OutputSink* sink = nullptr, std::size_t chunk = std::size_t(1) << 20)
+            : sink(sink), chunk(chunk) {
+            if (sink) buf.reserve(chunk);
+        }
+        RenderBuffer(RenderBuffer&&) = default;
+        ~RenderBuffer() {
+            try {
+                flush();
+            } catch (...) {
+            }
+        }
+
+        void append(const char* data, std::size_t size) {
+            buf.append(data, size);
+            if (buf.size() >= chunk) {
+                if (sink) {
+                    flush();
+                } else {
+                    seal();
+                }
+            }
+        }
+        void append(std::string_view s) { append(s.data(), s.size()); }
+
+        void append(RenderBuffer&& other) {
+            other.seal();
+            if (sink) {
+                flush();
+                for (const std::string& part : other.sealed) {
+                    sink->write(part.data(), part.size());
+                }
+            } else {
+                seal();
+                std::move(other.sealed.begin(), other.sealed.end(), std::back_inserter(sealed));
+            }
+            other.sealed.clear();
+        }
+
+        void indent(std::size_t n) {
+            static const std::string pad(256, ' ');
+            for (; n > pad.size(); n -= pad.size()) {
+                append(pad.data(), pad.size());
+            }
+            append(pad.data(), n);
+        }
+
+        // Hands everything buffered so far to the sink, keeping the capacity.
+        void flush() {
+            if (sink && !buf.empty()) {
+                sink->write(buf.data(), buf.size());
+                buf.clear();
+            }
+        }
+};
+
+// Compact form of a whole hierarchy: nodes live in one array in DFS order,
+// and a node's subtree is the range [i, i + subtreeSize). Children are
+// reached by skipping over subtrees, so walks are plain loops with no
+// recursion, virtual calls or reference counting.
+class FlatTree {
+    public:
+        struct Node {
+            std::uint32_t nameOffset;
+            std::uint32_t nameLength;
+            std::uint32_t subtreeSize;
+            std::uint16_t depth;
+            bool isFolder;
+        };
+
+        std::uint32_t beginFolder(std::string_view name, std::uint16_t depth) {
+            return push(name, depth, true);
+        }
+
+        void endFolder(std::uint32_t index) {
+            nodes[index].subtreeSize = std::uint32_t(nodes.size()) - index;
+        }
+
+        void addFile(std::string_view name, std::uint16_t depth) {
+            push(name, depth, false);
+        }
+
+        std::size_t size() const { return nodes.size(); }
+        const Node& operator[](std::size_t i) const { return nodes[i]; }
+
+        std::string_view name(std::size_t i) const {
+            return names.view(nodes[i].nameOffset, nodes[i].nameLength);
+        }
+
+        // Calls f(childIndex) for each direct child of the folder at index.
+        template <typename F>
+        void forEachChild(std::uint32_t index, F f) const {
+            std::uint32_t end = index + nodes[index].subtreeSize;
+            for (std::uint32_t i = index + 1; i < end; i += nodes[i].subtreeSize) {
+                f(i);
+            }
+        }
+
+        // Same output as FileSystemEntity::showDetails, as a single loop.
+        void render(RenderBuffer& out, std::size_t first = 0, std::size_t last = SIZE_MAX) const {
+            last = std::min(last, nodes.size());
+            for (std::size_t i = first; i < last; ++i) {
+                out.indent(std::size_t(nodes[i].depth) * 2);
+                if (nodes[i].isFolder) {
+                    out.append(name(i));
+                    out.append(": \n");
+                } else {
+                    out.append("- File: ");
+                    out.append(name(i));
+                    out.append("\n");
+                }
+            }
+        }
+
+        void show(std::ostream& out) const {
+            OstreamSink sink(out);
+            RenderBuffer buffer(&sink);
+            render(buffer);
+        }
+
+    private:
+        std::vector<Node> nodes;
+        StringArena names;
+
+        std::uint32_t push(std::string_view name, std::uint16_t depth, bool isFolder) {
+            nodes.push_back({names.intern(name), std::uint32_t(name.size()), 1, depth, isFolder});
+            return std::uint32_t(nodes.size() - 1);
+        }
+};
+
+// Fork-join pool. Each worker owns a deque: it pushes and pops its own
+// tasks at the back (newest, cache-warm subtrees first) and steals from
+// the front of other workers' deques when it runs dry.
+class WorkStealingPool {
+        struct Queue {
+            std::mutex m;
+            std::deque<std::function<void()>> tasks;
+        };
+
+        std::vector<std::unique_ptr<Queue>> queues;
+        std::vector<std::thread> threads;
+        std::mutex sleepMutex;
+        std::condition_variable wake;
+        std::atomic<std::size_t> queued{0};
+        std::atomic<std::size_t> nextQueue{0};
+        bool stopping = false;
+
+        static thread_local WorkStealingPool* currentPool;
+        static thread_local std::size_t currentIndex;
+
+        bool take(std::size_t index, bool back, std::function<void()>& task) {
+            Queue& q = *queues[index];
+            std::lock_guard<std::mutex> lock(q.m);
+            if (q.tasks.empty()) return false;
+            if (back) {
+                task = std::move(q.tasks.back());
+                q.tasks.pop_back();
+            } else {
+                task = std::move(q.tasks.front());
+                q.tasks.pop_front();
+            }
+            --queued;
+            return true;
+        }
+
+        void work(std::size_t index) {
+            currentPool = this;
+            currentIndex = index;
+            for (;;) {
+                if (runOne()) continue;
+                std::unique_lock<std::mutex> lock(sleepMutex);
+                wake.wait(lock, [this] { return stopping || queued > 0; });
+                if (stopping && queued == 0) return;
+            }
+        }
+
+    public:
+        explicit WorkStealingPool(unsigned n = std::max(1u, std::thread::hardware_concurrency())) {
+            for (unsigned i = 0; i < n; ++i) {
+                queues.push_back(std::make_unique<Queue>());
+            }
+            for (unsigned i = 0; i < n; ++i) {
+                threads.emplace_back([this, i] { work(i); });
+            }
+        }
+
+        ~WorkStealingPool() {
+            {
+                std::lock_guard<std::mutex> lock(sleepMutex);
+                stopping = true;
+            }
+            wake.notify_all();
+            for (auto& t : threads) {
+                t.join();
+            }
+        }
+
+        void submit(std::function<void()> task) {
+            std::size_t index = currentPool == this ? currentIndex
+                : nextQueue++ % queues.size();
+            {
+                std::lock_guard<std::mutex> lock(queues[index]->m);
+                queues[index]->tasks.push_back(std::move(task));
+            }
+            {
+                std::lock_guard<std::mutex> lock(sleepMutex);
+                ++queued;
+            }
+            wake.notify_one();
+        }
+
+        std::size_t size() const { return queues.size(); }
+
+        // Runs one queued task on the calling thread, if there is any.
+        bool runOne() {
+            std::function<void()> task;
+            std::size_t self = currentPool == this ? currentIndex : 0;
+            bool found = currentPool == this && take(self, true, task);
+            for (std::size_t i = 1; !found && i <= queues.size(); ++i) {
+                found = take((self + i) % queues.size(), false, task);
+            }
+            if (found) task();
+            return found;
+        }
+};
+
+thread_local WorkStealingPool* WorkStealingPool::currentPool = nullptr;
+thread_local std::size_t WorkStealingPool::currentIndex = 0;
+
+// Tasks forked from one parent. wait() helps run queued work instead of
+// blocking, so nested fork-join never starves the pool. A task that throws
+// still counts as finished; the first exception is kept and rethrown by
+// wait() once every task is done.
+class TaskGroup {
+        WorkStealingPool& pool;
+        std::atomic<std::size_t> pending{0};
+        std::atomic<bool> failed{false};
+        std::mutex errorMutex;
+        std::exception_ptr error;
+    public:
+        explicit TaskGroup(WorkStealingPool& p) : pool(p) {}
+
+        template <typename F>
+        void run(F f) {
+            ++pending;
+            pool.submit([this, f] {
+                try {
+                    f();
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(errorMutex);
+                    if (!error) error = std::current_exception();
+                    failed = true;
+                }
+                --pending;
+            });
+        }
+
+        void wait() {
+            while (pending > 0) {
+                if (!pool.runOne()) std::this_thread::yield();
+            }
+            if (failed) {
+                std::exception_ptr e;
+                {
+                    std::lock_guard<std::mutex> lock(errorMutex);
+                    e = std::exchange(error, nullptr);
+                    failed = false;
+                }
+                std::rethrow_exception(e);
+            }
+        }
+
+        // Helps run queued work until flag is set by one of the tasks. If a
+        // task throws instead, waits for the rest and rethrows.
+        void waitFor(const std::atomic<bool>& flag) {
+            while (!flag) {
+                if (failed) wait();
+                if (!pool.runOne()) std::this_thread::yield();
+            }
+        }
+};
+
+// Output of a subtree rendered as a task, and whether it is complete.
+struct RenderPart {
+    RenderBuffer buffer;
+    std::atomic<bool> done{false};
+    std::size_t index = 0; // the child or range it renders
+};
+
+// Renders a FlatTree in parallel: DFS order means any range of nodes renders
+// independently, so fixed-size ranges are rendered into their own buffers
+// and handed to out in order, each as soon as the ones before it are done.
+void renderParallel(const FlatTree& tree, RenderBuffer& out, WorkStealingPool& pool,
+        std::size_t nodesPerTask = 65536) {
+    std::size_t tasks = (tree.size() + nodesPerTask - 1) / nodesPerTask;
+    std::deque<RenderPart> parts(tasks);
+    TaskGroup group(pool);
+    for (std::size_t t = 0; t < tasks; ++t) {
+        RenderPart* part = &parts[t];
+        group.run([&tree, part, t, nodesPerTask] {
+            tree.render(part->buffer, t * nodesPerTask, (t + 1) * nodesPerTask);
+            part->done = true;
+        });
+    }
+    try {
+        for (RenderPart& part : parts) {
+            group.waitFor(part.done);
+            out.append(std::move(part.buffer));
+        }
+        group.wait(); // the tasks still touch the group after setting done
+    } catch (...) {
+        group.wait();
+        throw;
+    }
+}
+
+// Summary of a subtree.
+struct Aggregate {
+    std::uint64_t totalSize = 0;
+    std::uint64_t fileCount = 0;
+    std::uint64_t entries = 0;  // files and folders, including the root
+    std::uint32_t maxDepth = 0; // levels, counting the root as 1
+};
+
+class Folder;
 
 // Component
 class FileSystemEntity {
+    protected:
+        friend class Folder;
+        Folder* parent = nullptr;
     public:
         virtual void showDetails(int indent = 0) const = 0;
+        virtual void flattenInto(FlatTree& tree, std::uint16_t depth = 0) const = 0;
+        // Aggregates the subtree, forking large subfolders onto pool if given.
+        // Queries and add() must not run concurrently with each other.
+        virtual Aggregate aggregate(WorkStealingPool* pool = nullptr) const = 0;
+        // Buffered equivalent of showDetails. With a pool, large subfolders
+        // render into their own buffers in parallel and are appended in order.
+        virtual void render(RenderBuffer& out, int indent = 0, WorkStealingPool* pool = nullptr) const = 0;
         virtual ~FileSystemEntity() = default;
 };
 
 // Leaf
 class File : public FileSystemEntity {
         std::string name;
+        std::uint64_t size;
     public:
-        File(std::string n) : name(std::move(n)) {}
+        File(std::string n, std::uint64_t size = 0) : name(std::move(n)), size(size) {}
 
         void showDetails(int indent = 0) const override {
             std::cout  << std::string(indent, ' ') << "- File: " <<
                 name << std::endl;
         }
+
+        void flattenInto(FlatTree& tree, std::uint16_t depth = 0) const override {
+            tree.addFile(name, depth);
+        }
+
+        Aggregate aggregate(WorkStealingPool* = nullptr) const override {
+            return {size, 1, 1, 1};
+        }
+
+        void render(RenderBuffer& out, int indent = 0, WorkStealingPool* = nullptr) const override {
+            out.indent(std::size_t(indent));
+            out.append("- File: ");
+            out.append(name);
+            out.append("\n");
+        }
 };
 
 // Composite
 class Folder : public FileSystemEntity {
     std::string name;
     std::vector<std::shared_ptr<FileSystemEntity>> children;
+    // Cached aggregate of this subtree. A valid folder only has valid
+    // descendants, so invalidation can stop at the first invalid ancestor.
+    mutable Aggregate cached;
+    mutable bool valid = false;
+    // Files and folders in this subtree, including itself. Kept exact by
+    // add(), so fork decisions never depend on the cache being warm.
+    std::uint64_t entries = 1;
+
+    // Subfolders with at least this many entries are rendered as separate
+    // tasks.
+    static const std::uint64_t parallelGrain = 4096;
+
+    static bool isLarge(const FileSystemEntity& child) {
+        auto folder = dynamic_cast<const Folder*>(&child);
+        return folder && folder->entries >= parallelGrain;
+    }
+
+    static std::uint64_t entriesIn(const FileSystemEntity& entity) {
+        auto folder = dynamic_cast<const Folder*>(&entity);
+        return folder ? folder->entries : 1;
+    }
+
+    // Stale subfolders with at least parallelGrain entries are aggregated
+    // as separate tasks; smaller ones are cheaper to do inline.
+    static bool worthForking(const FileSystemEntity& child) {
+        auto folder = dynamic_cast<const Folder*>(&child);
+        return folder && !folder->valid && folder->entries >= parallelGrain;
+    }
 
     public:
         Folder(std::string n) : name(std::move(n)) {}
+        Folder(const Folder&) = delete;
+        Folder& operator=(const Folder&) = delete;
+        ~Folder() override {
+            for (const auto& child: children) {
+                child->parent = nullptr;
+            }
+        }
+
+        // An entity belongs to at most one folder, and a folder cannot be
+        // added below itself.
         void add(const std::shared_ptr<FileSystemEntity>& entity) {
+            if (entity->parent) {
+                throw std::invalid_argument("entity already belongs to a folder");
+            }
+            for (const Folder* f = this; f; f = f->parent) {
+                if (f == entity.get()) throw std::invalid_argument("folder added below itself");
+            }
+            entity->parent = this;
             children.push_back(entity);
+            std::uint64_t added = entriesIn(*entity);
+            for (Folder* f = this; f; f = f->parent) {
+                f->entries += added;
+            }
+            for (Folder* f = this; f && f->valid; f = f->parent) {
+                f->valid = false;
+            }
+        }
+
+        Aggregate aggregate(WorkStealingPool* pool = nullptr) const override {
+            if (valid) return cached;
+            std::vector<Aggregate> parts(children.size());
+            if (pool) {
+                TaskGroup group(*pool);
+                try {
+                    for (std::size_t i = 0; i < children.size(); ++i) {
+                        const FileSystemEntity* child = children[i].get();
+                        if (worthForking(*child)) {
+                            group.run([&parts, i, child, pool] { parts[i] = child->aggregate(pool); });
+                        } else {
+                            parts[i] = child->aggregate(pool);
+                        }
+                    }
+                    group.wait();
+                } catch (...) {
+                    group.wait();
+                    throw;
+                }
+            } else {
+                for (std::size_t i = 0; i < children.size(); ++i) {
+                    parts[i] = children[i]->aggregate();
+                }
+            }
+
+            Aggregate total{0, 0, 1, 1};
+            for (const Aggregate& part : parts) {
+                total.totalSize += part.totalSize;
+                total.fileCount += part.fileCount;
+                total.entries += part.entries;
+                total.maxDepth = std::max(total.maxDepth, part.maxDepth + 1);
+            }
+            cached = total;
+            valid = true;
+            return total;
+        }
+
+        void render(RenderBuffer& out, int indent = 0, WorkStealingPool* pool = nullptr) const override {
+            out.indent(std::size_t(indent));
+            out.append(name);
+            out.append(": \n");
+            if (!pool || entries < parallelGrain) {
+                for (const auto& child: children) {
+                    child->render(out, indent + 2);
+                }
+                return;
+            }
+
+            // Large children render into their own buffers as tasks, at most
+            // a few per worker ahead of the child being written. Everything
+            // else goes straight to out in order, and each task's buffer
+            // follows as soon as it is reached, so a sink keeps streaming.
+            std::size_t window = 2 * pool->size();
+            std::deque<RenderPart> inFlight;
+            std::size_t ahead = 0; // next child to consider forking
+            TaskGroup group(*pool);
+            try {
+                for (std::size_t i = 0; i < children.size(); ++i) {
+                    for (ahead = std::max(ahead, i + 1); ahead < children.size() && inFlight.size() < window; ++ahead) {
+                        if (!isLarge(*children[ahead])) continue;
+                        RenderPart* part = &inFlight.emplace_back();
+                        part->index = ahead;
+                        const FileSystemEntity* c = children[ahead].get();
+                        group.run([part, c, indent, pool] {
+                            c->render(part->buffer, indent + 2, pool);
+                            part->done = true;
+                        });
+                    }
+                    if (!inFlight.empty() && inFlight.front().index == i) {
+                        group.waitFor(inFlight.front().done);
+                        out.append(std::move(inFlight.front().buffer));
+                        inFlight.pop_front();
+                    } else {
+                        children[i]->render(out, indent + 2, pool);
+                    }
+                }
+                group.wait();
+            } catch (...) {
+                group.wait();
+                throw;
+            }
         }
         void showDetails(int indent = 0) const override {
             std::cout << std::string(indent, ' ') << name << ": " << std::endl;
@@ -52,12 +655,19 @@ class Folder : public FileSystemEntity {
                 child->showDetails(indent + 2);
             }
         }
+        void flattenInto(FlatTree& tree, std::uint16_t depth = 0) const override {
+            std::uint32_t index = tree.beginFolder(name, depth);
+            for (const auto& child: children) {
+                child->flattenInto(tree, depth + 1);
+            }
+            tree.endFolder(index);
+        }
 };
 
 int main() {
-    auto file1 = std::make_shared<File>("Resume.pdf");
-    auto file2 = std::make_shared<File>("Photo.jpg");
-    auto file3 = std::make_shared<File>("Design.docx");
+    auto file1 = std::make_shared<File>("Resume.pdf", 120000);
+    auto file2 = std::make_shared<File>("Photo.jpg", 2400000);
+    auto file3 = std::make_shared<File>("Design.docx", 56000);
 
     auto workFolder = std::make_shared<Folder>("Work");
     workFolder->add(file1);
@@ -68,4 +678,52 @@ int main() {
     homeFolder->add(workFolder);
 
     homeFolder->showDetails();
+
+    FlatTree flat;
+    homeFolder->flattenInto(flat);
+    std::cout << "Flattened (" << flat.size() << " nodes):" << std::endl;
+    flat.show(std::cout);
+
+    // Streaming render straight to the stdout descriptor, flushed in chunks.
+    std::cout.flush();
+    WorkStealingPool renderPool;
+    FdSink stdoutSink(STDOUT_FILENO);
+    {
+        RenderBuffer out(&stdoutSink);
+        out.append("Rendered:\n");
+        homeFolder->render(out, 0, &renderPool);
+        renderParallel(flat, out, renderPool);
+    }
+
+    auto printAggregate = [](const Aggregate& a) {
+        std::cout << "Total size: " << a.totalSize << " bytes, files: " << a.fileCount
+            << ", max depth: " << a.maxDepth << std::endl;
+    };
+    WorkStealingPool pool;
+    printAggregate(homeFolder->aggregate(&pool));
+
+    // Adding to Work invalidates only Work and Home. Home sums its children
+    // again, but a subfolder that had not changed would return its cache.
+    workFolder->add(std::make_shared<File>("Notes.txt", 800));
+    printAggregate(homeFolder->aggregate(&pool));
+
+    // Subfolders of at least parallelGrain entries are aggregated as tasks.
+    auto makeArchive = [] {
+        auto archive = std::make_shared<Folder>("Archive");
+        for (int y = 0; y < 4; ++y) {
+            auto year = std::make_shared<Folder>("Year" + std::to_string(y));
+            for (int i = 0; i < 5000; ++i) {
+                year->add(std::make_shared<File>("scan" + std::to_string(i) + ".png", std::uint64_t(i * (y + 1))));
+            }
+            archive->add(year);
+        }
+        return archive;
+    };
+    Aggregate parallel = makeArchive()->aggregate(&pool);
+    Aggregate serial = makeArchive()->aggregate();
+    bool same = parallel.totalSize == serial.totalSize && parallel.fileCount == serial.fileCount &&
+        parallel.entries == serial.entries && parallel.maxDepth == serial.maxDepth;
+    std::cout << "Archive, " << parallel.entries << " entries: parallel aggregate "
+        << (same ? "matches" : "differs from") << " the serial walk" << std::endl;
+    printAggregate(parallel);
 }
\ No newline at end of file
@@ -8,14 +8,67 @@
 // RealDatabase – real database access implementation (RealSubject)
 // DatabaseProxy – controls access to RealDatabase based on role
 // User – has a role (e.g., Admin, Guest)
+// PolicyEngine – per-table, per-operation rules the proxy checks on every call
 
 #include <iostream>
 #include <string>
+#include <memory>
+#include <vector>
+#include <unordered_map>
+#include <list>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <cstdint>
+#include <limits>
+#include <algorithm>
+#include <array>
+#include <optional>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <shared_mutex>
+#include <set>
+#include <cstring>
+#include <cerrno>
+#include <fstream>
+#include <iterator>
+#include <utility>
+#include <filesystem>
+#include <system_error>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
 
 class Database {
     public:
         virtual void read() const = 0;
         virtual void write(const std::string& data) const = 0;
+        // Keyed access. An empty optional means the key does not exist.
+        virtual std::optional<std::string> read(const std::string& key) const = 0;
+        virtual void write(const std::string& key, const std::string& value) const = 0;
+
+        // Many keyed operations in one call. Databases that can do a batch in
+        // one round trip override these; the defaults just loop.
+        virtual std::vector<std::optional<std::string>> readMany(
+            const std::vector<std::string>& keys) const {
+            std::vector<std::optional<std::string>> values;
+            values.reserve(keys.size());
+            for (const std::string& key : keys) {
+                values.push_back(read(key));
+            }
+            return values;
+        }
+
+        virtual void writeMany(
+            const std::vector<std::pair<std::string, std::string>>& rows) const {
+            for (const auto& [key, value] : rows) {
+                write(key, value);
+            }
+        }
+
         virtual ~Database() = default;
 };
 
@@ -29,51 +82,1813 @@ class RealDatabase : public Database {
             std::cout << "[Database] Writing to the database: " 
                 << data << std::endl;
         }
+
+        std::optional<std::string> read(const std::string& key) const override {
+            std::cout << "[Database] Reading " << key << std::endl;
+            return std::nullopt;
+        }
+
+        void write(const std::string& key, const std::string& value) const override {
+            std::cout << "[Database] Writing " << key << " = " << value << std::endl;
+        }
 };
 
 enum class Role {
     Guest,
+    Analyst,
+    Editor,
     Admin
 };
 
+enum class Operation {
+    Read,
+    Write
+};
+
+constexpr std::size_t kRoleCount = 4;
+constexpr std::size_t kOperationCount = 2;
+
+const char* roleName(Role role) {
+    switch (role) {
+        case Role::Guest: return "Guest";
+        case Role::Analyst: return "Analyst";
+        case Role::Editor: return "Editor";
+        case Role::Admin: return "Admin";
+    }
+    return "?";
+}
+
+// Epoch-based reclamation for read-mostly data published through an atomic
+// pointer. Readers pin the current epoch in a per-thread slot for the length
+// of a check, which is a couple of stores and loads and never waits. Writers
+// retire old objects with the epoch they were unpublished in, and an object
+// is freed once every pinned reader has moved past that epoch.
+class EpochDomain {
+    static constexpr std::uint64_t kIdle = std::numeric_limits<std::uint64_t>::max();
+
+    struct Slot {
+        std::atomic<std::uint64_t> epoch{kIdle};
+        std::atomic<bool> inUse{false};
+        Slot* next = nullptr;
+    };
+
+    // Hands a slot to the thread for its lifetime and back to the list on exit.
+    struct Lease {
+        Slot* slot;
+        explicit Lease(EpochDomain& domain) : slot(domain.acquireSlot()) {}
+        ~Lease() { slot->inUse.store(false, std::memory_order_release); }
+    };
+
+    std::atomic<std::uint64_t> globalEpoch{1};
+    std::atomic<Slot*> slots{nullptr};
+    std::mutex retireMutex;
+    std::vector<std::pair<std::uint64_t, std::function<void()>>> retired;
+
+    EpochDomain() = default;
+
+    Slot* acquireSlot() {
+        for (Slot* s = slots.load(std::memory_order_acquire); s; s = s->next) {
+            bool expected = false;
+            if (!s->inUse.load(std::memory_order_relaxed) &&
+                s->inUse.compare_exchange_strong(expected, true)) {
+                return s;
+            }
+        }
+        Slot* s = new Slot;
+        s->inUse.store(true, std::memory_order_relaxed);
+        s->next = slots.load(std::memory_order_relaxed);
+        while (!slots.compare_exchange_weak(s->next, s)) {
+        }
+        return s;
+    }
+
+    Slot* localSlot() {
+        thread_local Lease lease(*this);
+        return lease.slot;
+    }
+
+    // Oldest epoch some reader may still be looking at. Caller holds retireMutex.
+    std::uint64_t oldestPinned() const {
+        std::uint64_t oldest = kIdle;
+        for (Slot* s = slots.load(std::memory_order_acquire); s; s = s->next) {
+            oldest = std::min(oldest, s->epoch.load());
+        }
+        return oldest;
+    }
+
+    void reclaimLocked() {
+        std::uint64_t oldest = oldestPinned();
+        auto kept = retired.begin();
+        for (auto it = retired.begin(); it != retired.end(); ++it) {
+            if (it->first < oldest) {
+                it->second();
+            } else {
+                *kept++ = std::move(*it);
+            }
+        }
+        retired.erase(kept, retired.end());
+    }
+
+    public:
+        static EpochDomain& instance() {
+            static EpochDomain domain;
+            return domain;
+        }
+
+        ~EpochDomain() {
+            for (auto& entry : retired) {
+                entry.second();
+            }
+            for (Slot* s = slots.load(); s;) {
+                Slot* next = s->next;
+                delete s;
+                s = next;
+            }
+        }
+
+        // Keeps everything retired after it was taken alive until it goes away.
+        class Guard {
+            Slot* slot;
+            public:
+                explicit Guard(Slot* s) : slot(s) {}
+                Guard(const Guard&) = delete;
+                Guard& operator=(const Guard&) = delete;
+                ~Guard() { slot->epoch.store(kIdle, std::memory_order_release); }
+        };
+
+        // The seq_cst store pairs with the seq_cst exchange in the publisher:
+        // a reader either shows up in the writer's slot scan or sees the new
+        // pointer.
+        Guard pin() {
+            Slot* slot = localSlot();
+            slot->epoch.store(globalEpoch.load(std::memory_order_relaxed));
+            return Guard(slot);
+        }
+
+        void retire(std::function<void()> deleter) {
+            std::lock_guard<std::mutex> lock(retireMutex);
+            retired.emplace_back(globalEpoch.fetch_add(1), std::move(deleter));
+            reclaimLocked();
+        }
+
+        // Frees whatever no reader can still see. Writers call it through retire().
+        void reclaim() {
+            std::lock_guard<std::mutex> lock(retireMutex);
+            reclaimLocked();
+        }
+};
+
+using ResourceId = std::uint32_t;
+
+// Allow or deny `op` on `table` for `role`. The table "*" matches every
+// table. Rules apply in order, table-specific ones after wildcards, so a
+// later rule overrides an earlier one.
+struct PolicyRule {
+    Role role;
+    std::string table;
+    Operation op;
+    bool allow = true;
+};
+
+// A compiled policy: one row of role x operation bits per known table, plus
+// the wildcard row for tables that were first seen after compilation.
+class PolicySnapshot {
+    static constexpr std::size_t kBitsPerResource = kRoleCount * kOperationCount;
+
+    std::uint64_t policyVersion;
+    std::size_t resources;
+    std::vector<std::uint64_t> bits;
+    std::uint64_t wildcardRow = 0;
+
+    static std::size_t column(Role role, Operation op) {
+        return std::size_t(role) * kOperationCount + std::size_t(op);
+    }
+
+    public:
+        PolicySnapshot(std::uint64_t version, std::size_t resourceCount,
+            const std::vector<PolicyRule>& rules,
+            const std::unordered_map<std::string, ResourceId>& ids)
+            : policyVersion(version), resources(resourceCount),
+              bits((resourceCount * kBitsPerResource + 63) / 64, 0) {
+            for (const PolicyRule& rule : rules) {
+                if (rule.table != "*") {
+                    continue;
+                }
+                std::uint64_t mask = std::uint64_t(1) << column(rule.role, rule.op);
+                wildcardRow = rule.allow ? (wildcardRow | mask) : (wildcardRow & ~mask);
+            }
+            for (ResourceId id = 0; id < resources; ++id) {
+                for (std::size_t c = 0; c < kBitsPerResource; ++c) {
+                    if (wildcardRow >> c & 1) {
+                        set(id, c, true);
+                    }
+                }
+            }
+            for (const PolicyRule& rule : rules) {
+                if (rule.table != "*") {
+                    set(ids.at(rule.table), column(rule.role, rule.op), rule.allow);
+                }
+            }
+        }
+
+        bool allows(Role role, ResourceId id, Operation op) const noexcept {
+            std::size_t c = column(role, op);
+            if (id >= resources) {
+                return wildcardRow >> c & 1;
+            }
+            std::size_t bit = id * kBitsPerResource + c;
+            return bits[bit / 64] >> (bit % 64) & 1;
+        }
+
+        std::uint64_t version() const { return policyVersion; }
+
+    private:
+        void set(ResourceId id, std::size_t c, bool allow) {
+            std::size_t bit = id * kBitsPerResource + c;
+            std::uint64_t mask = std::uint64_t(1) << (bit % 64);
+            bits[bit / 64] = allow ? (bits[bit / 64] | mask) : (bits[bit / 64] & ~mask);
+        }
+};
+
+// Compiles rules into a PolicySnapshot and publishes it RCU-style: checks
+// read the current snapshot without locks while reload() builds the next one
+// on the side, swaps it in, and retires the old one through the EpochDomain.
+// Table names are interned once into stable ResourceIds so a proxy resolves
+// its table at construction and every check is a bit lookup.
+class PolicyEngine {
+    mutable std::mutex writerMutex;
+    std::unordered_map<std::string, ResourceId> ids;
+    std::vector<PolicyRule> rules;
+    std::uint64_t nextVersion = 1;
+    std::atomic<const PolicySnapshot*> current{nullptr};
+
+    const PolicySnapshot* compileLocked() {
+        for (const PolicyRule& rule : rules) {
+            if (rule.table != "*") {
+                internLocked(rule.table);
+            }
+        }
+        return new PolicySnapshot(nextVersion++, ids.size(), rules, ids);
+    }
+
+    ResourceId internLocked(const std::string& table) {
+        auto it = ids.emplace(table, ResourceId(ids.size())).first;
+        return it->second;
+    }
+
+    public:
+        explicit PolicyEngine(std::vector<PolicyRule> initial) : rules(std::move(initial)) {
+            current.store(compileLocked());
+        }
+
+        PolicyEngine(const PolicyEngine&) = delete;
+        PolicyEngine& operator=(const PolicyEngine&) = delete;
+
+        // Proxies hold the engine, so no check can be running here.
+        ~PolicyEngine() {
+            delete current.load();
+        }
+
+        ResourceId resource(const std::string& table) {
+            std::lock_guard<std::mutex> lock(writerMutex);
+            return internLocked(table);
+        }
+
+        bool allows(Role role, ResourceId id, Operation op) const noexcept {
+            EpochDomain::Guard guard = EpochDomain::instance().pin();
+            return current.load()->allows(role, id, op);
+        }
+
+        // Replaces every rule. Checks in flight finish against the old policy.
+        void reload(std::vector<PolicyRule> replacement) {
+            const PolicySnapshot* old;
+            {
+                std::lock_guard<std::mutex> lock(writerMutex);
+                rules = std::move(replacement);
+                old = current.exchange(compileLocked());
+            }
+            EpochDomain::instance().retire([old] { delete old; });
+        }
+
+        std::uint64_t version() const {
+            EpochDomain::Guard guard = EpochDomain::instance().pin();
+            return current.load()->version();
+        }
+};
+
 class DatabaseProxy : public Database {
+    std::shared_ptr<Database> realDb;
+    std::shared_ptr<PolicyEngine> policy;
     Role role;
-    std::shared_ptr<RealDatabase> realDb;
+    std::string table;
+    ResourceId resource;
+
+    bool check(Operation op, const char* verb) const {
+        if (policy->allows(role, resource, op)) {
+            return true;
+        }
+        std::cout << "[Proxy] Access denied. " << roleName(role) << " may not "
+            << verb << " " << table << std::endl;
+        return false;
+    }
 
     public:
-        DatabaseProxy(Role role) : 
-            realDb(std::make_shared<RealDatabase>()),
-            role(role) {}
+        // Guards `db`, or a RealDatabase when none is given, so it can sit in
+        // front of other proxies such as CachingDatabaseProxy.
+        DatabaseProxy(std::shared_ptr<PolicyEngine> policy, Role role, std::string table,
+            std::shared_ptr<Database> db = nullptr) :
+            realDb(db ? std::move(db) : std::make_shared<RealDatabase>()),
+            policy(std::move(policy)),
+            role(role),
+            table(std::move(table)),
+            resource(this->policy->resource(this->table)) {}
 
         void read() const override {
-            std::cout << "[Proxy] Access granted for reading";
-            realDb->read();
+            if (check(Operation::Read, "read")) {
+                std::cout << "[Proxy] Access granted for reading. ";
+                realDb->read();
+            }
         }
 
         void write(const std::string& data) const override {
-            if (role == Role::Guest) {
-                std::cout << "[Proxy] Access denied. Write access need Admin role" 
-                 << std::endl;
-            }
-            else if (role == Role::Admin) {
+            if (check(Operation::Write, "write")) {
                 std::cout << "[Proxy] Write access granted." << std::endl;
                 realDb->write(data);
             }
         }
+
+        std::optional<std::string> read(const std::string& key) const override {
+            if (!check(Operation::Read, "read")) {
+                return std::nullopt;
+            }
+            return realDb->read(key);
+        }
+
+        void write(const std::string& key, const std::string& value) const override {
+            if (check(Operation::Write, "write")) {
+                realDb->write(key, value);
+            }
+        }
+
+        std::vector<std::optional<std::string>> readMany(
+            const std::vector<std::string>& keys) const override {
+            if (!check(Operation::Read, "read")) {
+                return std::vector<std::optional<std::string>>(keys.size());
+            }
+            return realDb->readMany(keys);
+        }
+
+        void writeMany(
+            const std::vector<std::pair<std::string, std::string>>& rows) const override {
+            if (check(Operation::Write, "write")) {
+                realDb->writeMany(rows);
+            }
+        }
+};
+
+struct KvOptions {
+    std::size_t shards = 16;
+    std::string walPath;  // empty: no write-ahead log
+    bool syncWal = false; // a commit returns only once its log record is synced
 };
 
-int main() {
-    DatabaseProxy *db1 = new DatabaseProxy(Role::Guest);
+// In-memory key-value engine with multi-version concurrency control.
+//
+// Keys are spread over shards. Each shard has a shared_mutex that only
+// guards its key -> record map; it is taken exclusively just to add a key.
+// A record holds a chain of versions, newest first, each tagged with the
+// commit timestamp of the write that made it. Readers walk the chain
+// without locks and take the newest version at or below their snapshot
+// timestamp, so reads never block writes or each other.
+//
+// A commit (write or writeMany) encodes its rows outside any lock, then
+// takes the next timestamp and appends them to the write-ahead log as one
+// checksummed record under the log mutex, so log order is timestamp order.
+// A failed append is cut back off the log and takes no timestamp. With
+// syncWal the commit then waits for the log to be synced; the sync runs
+// outside the log mutex and one fdatasync covers every record appended
+// before it started (group commit). It then installs its versions.
+//
+// The visible watermark advances past a timestamp only once every commit
+// up to it is installed, so a snapshot never sees half a batch. Installed
+// timestamps are marked in a ring and whichever commit fills the gap moves
+// the watermark on, without a shared lock. Once a commit has its
+// timestamp it is published even if it then fails, so the watermark never
+// stalls behind it; such a commit may or may not have taken effect.
+//
+// On start-up the log is replayed up to the first record that is torn,
+// fails its checksum or does not parse, and the rest is cut off.
+//
+// vacuum() drops versions that no snapshot can reach. They are unlinked
+// under the record's writer mutex and freed through the EpochDomain once
+// readers still walking them are done.
+class KvDatabase : public Database {
+    struct Version {
+        std::uint64_t ts;
+        std::string value;
+        std::atomic<Version*> next{nullptr};
+    };
+
+    struct Record {
+        std::mutex writer; // orders installs and vacuum on this key
+        std::atomic<Version*> head{nullptr};
+        // Versions at or below this timestamp may have been vacuumed away.
+        std::atomic<std::uint64_t> trimmedAt{0};
+    };
+
+    struct Shard {
+        std::shared_mutex mutex;
+        std::unordered_map<std::string, std::unique_ptr<Record>> records;
+    };
+
+    using Rows = std::vector<std::pair<std::string, std::string>>;
+
+    // Commits may be in flight at most this far ahead of the watermark.
+    static constexpr std::uint64_t commitWindow = 4096;
+
+    KvOptions options;
+    mutable std::vector<Shard> shards;
+
+    mutable std::mutex walMutex;
+    int walFd = -1;
+    mutable std::uint64_t lastTs = 0;
+    mutable std::atomic<std::size_t> walEnd{0};
+    // Set once a write could not be undone or a sync failed: the kernel may
+    // have dropped the unsynced pages, so later syncs prove nothing.
+    mutable std::atomic<int> walError{0};
+
+    mutable std::mutex syncMutex;
+    mutable std::condition_variable syncDone;
+    mutable std::size_t syncedEnd = 0;
+    mutable bool syncing = false;
+
+    mutable std::atomic<std::uint64_t> visibleTs{0};
+    // Slot ts % commitWindow holds ts once that commit is installed.
+    std::unique_ptr<std::atomic<std::uint64_t>[]> installed;
+
+    mutable std::mutex snapshotMutex;
+    mutable std::multiset<std::uint64_t> snapshots;
+
+    Shard& shardFor(const std::string& key) const {
+        return shards[std::hash<std::string>{}(key) % shards.size()];
+    }
+
+    Record* find(const std::string& key) const {
+        Shard& shard = shardFor(key);
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        auto it = shard.records.find(key);
+        return it == shard.records.end() ? nullptr : it->second.get();
+    }
+
+    Record& findOrCreate(const std::string& key) const {
+        if (Record* record = find(key)) {
+            return *record;
+        }
+        Shard& shard = shardFor(key);
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        auto& slot = shard.records[key];
+        if (!slot) {
+            slot = std::make_unique<Record>();
+        }
+        return *slot;
+    }
+
+    // Newest version visible at `ts`, if the chain still reaches it.
+    static const Version* versionAt(const Record& record, std::uint64_t ts) {
+        for (const Version* v = record.head.load(std::memory_order_acquire); v;
+             v = v->next.load(std::memory_order_acquire)) {
+            if (v->ts <= ts) {
+                return v;
+            }
+        }
+        return nullptr;
+    }
+
+    // Concurrent commits may install out of timestamp order, so a version is
+    // linked in below any newer ones.
+    static void install(Record& record, std::uint64_t ts, std::string value) {
+        Version* version = new Version{ts, std::move(value), {nullptr}};
+        std::lock_guard<std::mutex> lock(record.writer);
+        std::atomic<Version*>* link = &record.head;
+        Version* cur = link->load(std::memory_order_relaxed);
+        while (cur && cur->ts > ts) {
+            link = &cur->next;
+            cur = link->load(std::memory_order_relaxed);
+        }
+        version->next.store(cur, std::memory_order_relaxed);
+        link->store(version, std::memory_order_release);
+    }
+
+    // Marks `ts` installed and advances the watermark over every installed
+    // timestamp that follows it. The mark is stored before the watermark is
+    // read, and the watermark is moved before the next mark is read, so of
+    // two commits finishing out of order at least one sees the other and
+    // carries the watermark past both.
+    void publish(std::uint64_t ts) const noexcept {
+        installed[ts % commitWindow].store(ts);
+        std::uint64_t visible = visibleTs.load();
+        while (installed[(visible + 1) % commitWindow].load() == visible + 1) {
+            if (visibleTs.compare_exchange_weak(visible, visible + 1)) {
+                ++visible;
+            }
+        }
+    }
+
+    // Log record: checksum, timestamp, row count, payload size, then per
+    // row the key and value sizes followed by their bytes. The CRC-32 covers
+    // the payload and then the 16 header bytes after it, so the payload's
+    // share is computed outside the log mutex.
+    static constexpr std::size_t recordHeader = 20;
+
+    static std::uint32_t crc32(const char* data, std::size_t size, std::uint32_t crc = 0) {
+        static const auto table = [] {
+            std::array<std::uint32_t, 256> t{};
+            for (std::uint32_t i = 0; i < 256; ++i) {
+                std::uint32_t c = i;
+                for (int k = 0; k < 8; ++k) {
+                    c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                }
+                t[i] = c;
+            }
+            return t;
+        }();
+        crc = ~crc;
+        for (std::size_t i = 0; i < size; ++i) {
+            crc = table[(crc ^ std::uint8_t(data[i])) & 0xFF] ^ (crc >> 8);
+        }
+        return ~crc;
+    }
+
+    static void appendU32(std::string& out, std::uint32_t v) {
+        out.append(reinterpret_cast<const char*>(&v), sizeof v);
+    }
+    static void appendU64(std::string& out, std::uint64_t v) {
+        out.append(reinterpret_cast<const char*>(&v), sizeof v);
+    }
+
+    static std::string encodeRows(const Rows& rows) {
+        std::size_t size = 0;
+        for (const auto& [key, value] : rows) {
+            if (key.size() > std::numeric_limits<std::uint32_t>::max() ||
+                value.size() > std::numeric_limits<std::uint32_t>::max()) {
+                throw std::length_error("KvDatabase: row too large for the log");
+            }
+            size += 8 + key.size() + value.size();
+        }
+        if (size > std::numeric_limits<std::uint32_t>::max()) {
+            throw std::length_error("KvDatabase: commit too large for the log");
+        }
+        std::string payload;
+        payload.reserve(size);
+        for (const auto& [key, value] : rows) {
+            appendU32(payload, std::uint32_t(key.size()));
+            appendU32(payload, std::uint32_t(value.size()));
+            payload += key;
+            payload += value;
+        }
+        return payload;
+    }
+
+    // Decodes exactly `count` rows filling `size` bytes, or returns false.
+    static bool decodeRows(const char* p, std::size_t size, std::uint32_t count, Rows& rows) {
+        const char* end = p + size;
+        for (std::uint32_t i = 0; i < count; ++i) {
+            std::uint32_t keySize, valueSize;
+            if (std::size_t(end - p) < 8) {
+                return false;
+            }
+            std::memcpy(&keySize, p, 4);
+            std::memcpy(&valueSize, p + 4, 4);
+            p += 8;
+            if (std::size_t(end - p) < std::size_t(keySize) + valueSize) {
+                return false;
+            }
+            rows.emplace_back(std::string(p, keySize), std::string(p + keySize, valueSize));
+            p += std::size_t(keySize) + valueSize;
+        }
+        return p == end;
+    }
+
+    // Appends one record at the end of the log and returns the new end.
+    // Called under walMutex. If the write fails the log is cut back to
+    // where it was, so a later record never lands after a torn one.
+    std::size_t logCommit(std::uint64_t ts, std::uint32_t count,
+        const std::string& payload, std::uint32_t payloadCrc) const {
+        if (int error = walError.load()) {
+            throw std::system_error(error, std::generic_category(), "write " + options.walPath);
+        }
+        std::string record;
+        record.reserve(recordHeader + payload.size());
+        appendU32(record, 0);
+        appendU64(record, ts);
+        appendU32(record, count);
+        appendU32(record, std::uint32_t(payload.size()));
+        std::uint32_t crc = crc32(record.data() + 4, recordHeader - 4, payloadCrc);
+        std::memcpy(&record[0], &crc, 4);
+        record += payload;
+        std::size_t start = walEnd.load(std::memory_order_relaxed);
+        for (std::size_t done = 0; done < record.size();) {
+            ssize_t n = ::pwrite(walFd, record.data() + done, record.size() - done, off_t(start + done));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                int error = n < 0 ? errno : EIO;
+                if (::ftruncate(walFd, off_t(start)) != 0) {
+                    walError.store(errno);
+                }
+                throw std::system_error(error, std::generic_category(), "write " + options.walPath);
+            }
+            done += std::size_t(n);
+        }
+        walEnd.store(start + record.size());
+        return start + record.size();
+    }
+
+    // Returns once the log is synced at least up to `end`. If no sync is
+    // running this commit runs one for everything appended so far;
+    // otherwise it waits for the running one and checks again.
+    void waitDurable(std::size_t end) const {
+        std::unique_lock<std::mutex> lock(syncMutex);
+        while (syncedEnd < end) {
+            if (int error = walError.load()) {
+                throw std::system_error(error, std::generic_category(), "fdatasync " + options.walPath);
+            }
+            if (syncing) {
+                syncDone.wait(lock);
+                continue;
+            }
+            syncing = true;
+            std::size_t target = walEnd.load();
+            lock.unlock();
+            int error = ::fdatasync(walFd) == 0 ? 0 : errno;
+            lock.lock();
+            syncing = false;
+            if (error == 0) {
+                syncedEnd = std::max(syncedEnd, target);
+            } else {
+                walError.store(error);
+            }
+            syncDone.notify_all();
+        }
+    }
+
+    // Replays the log and returns the length of its intact prefix: replay
+    // stops at the first record that is torn, fails its checksum, does not
+    // decode to its row count, or does not follow the previous timestamp.
+    std::size_t replay() {
+        std::ifstream in(options.walPath, std::ios::binary);
+        std::string log((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        std::size_t pos = 0;
+        Rows rows;
+        while (log.size() - pos >= recordHeader) {
+            std::uint32_t crc, count, bytes;
+            std::uint64_t ts;
+            std::memcpy(&crc, log.data() + pos, 4);
+            std::memcpy(&ts, log.data() + pos + 4, 8);
+            std::memcpy(&count, log.data() + pos + 12, 4);
+            std::memcpy(&bytes, log.data() + pos + 16, 4);
+            const char* payload = log.data() + pos + recordHeader;
+            if (log.size() - pos - recordHeader < bytes || ts <= lastTs ||
+                crc32(log.data() + pos + 4, recordHeader - 4, crc32(payload, bytes)) != crc) {
+                break;
+            }
+            rows.clear();
+            if (!decodeRows(payload, bytes, count, rows)) {
+                break;
+            }
+            for (auto& [key, value] : rows) {
+                install(findOrCreate(key), ts, std::move(value));
+            }
+            lastTs = ts;
+            pos += recordHeader + bytes;
+        }
+        visibleTs.store(lastTs);
+        return pos;
+    }
+
+    std::uint64_t commit(const Rows& rows) const {
+        std::string payload;
+        std::uint32_t payloadCrc = 0;
+        if (walFd >= 0) {
+            payload = encodeRows(rows);
+            payloadCrc = crc32(payload.data(), payload.size());
+        }
+        std::uint64_t ts;
+        std::size_t end = 0;
+        {
+            std::lock_guard<std::mutex> lock(walMutex);
+            // Commits ahead of the watermark finish without this mutex.
+            while (lastTs + 1 - visibleTs.load() >= commitWindow) {
+                std::this_thread::yield();
+            }
+            if (walFd >= 0) {
+                end = logCommit(lastTs + 1, std::uint32_t(rows.size()), payload, payloadCrc);
+            }
+            ts = ++lastTs;
+        }
+        struct Publish {
+            const KvDatabase* db;
+            std::uint64_t ts;
+            ~Publish() { db->publish(ts); }
+        } publishOnExit{this, ts};
+        if (end && options.syncWal) {
+            waitDurable(end);
+        }
+        for (const auto& [key, value] : rows) {
+            install(findOrCreate(key), ts, value);
+        }
+        return ts;
+    }
+
+    public:
+        explicit KvDatabase(KvOptions opts = {})
+            : options(std::move(opts)), shards(std::max<std::size_t>(1, options.shards)),
+              installed(new std::atomic<std::uint64_t>[commitWindow]) {
+            for (std::uint64_t i = 0; i < commitWindow; ++i) {
+                installed[i].store(0, std::memory_order_relaxed);
+            }
+            if (options.walPath.empty()) {
+                return;
+            }
+            std::size_t intact = replay();
+            walFd = ::open(options.walPath.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+            if (walFd < 0 || ::ftruncate(walFd, off_t(intact)) != 0) {
+                int error = errno;
+                if (walFd >= 0) {
+                    ::close(walFd);
+                }
+                throw std::system_error(error, std::generic_category(), "open " + options.walPath);
+            }
+            walEnd.store(intact);
+            syncedEnd = intact;
+        }
+
+        KvDatabase(const KvDatabase&) = delete;
+        KvDatabase& operator=(const KvDatabase&) = delete;
+
+        ~KvDatabase() override {
+            if (walFd >= 0) {
+                ::close(walFd);
+            }
+            for (Shard& shard : shards) {
+                for (auto& entry : shard.records) {
+                    for (Version* v = entry.second->head.load(); v;) {
+                        Version* next = v->next.load();
+                        delete v;
+                        v = next;
+                    }
+                }
+            }
+        }
+
+        // A consistent, repeatable view as of the visible watermark when it
+        // was taken. It holds back vacuum, so keep it short.
+        class Snapshot {
+            const KvDatabase* db;
+            std::uint64_t ts;
+
+            public:
+                Snapshot(const KvDatabase* db, std::uint64_t ts) : db(db), ts(ts) {}
+                Snapshot(Snapshot&& other) noexcept : db(other.db), ts(other.ts) { other.db = nullptr; }
+                Snapshot(const Snapshot&) = delete;
+                Snapshot& operator=(const Snapshot&) = delete;
+                Snapshot& operator=(Snapshot&&) = delete;
+
+                ~Snapshot() {
+                    if (db) {
+                        std::lock_guard<std::mutex> lock(db->snapshotMutex);
+                        db->snapshots.erase(db->snapshots.find(ts));
+                    }
+                }
+
+                std::optional<std::string> read(const std::string& key) const {
+                    EpochDomain::Guard guard = EpochDomain::instance().pin();
+                    const Record* record = db->find(key);
+                    const Version* v = record ? versionAt(*record, ts) : nullptr;
+                    return v ? std::optional<std::string>(v->value) : std::nullopt;
+                }
+
+                std::uint64_t timestamp() const { return ts; }
+        };
+
+        Snapshot snapshot() const {
+            std::lock_guard<std::mutex> lock(snapshotMutex);
+            std::uint64_t ts = visibleTs.load(std::memory_order_acquire);
+            snapshots.insert(ts);
+            return Snapshot(this, ts);
+        }
+
+        void read() const override {
+            std::size_t keys = 0;
+            for (Shard& shard : shards) {
+                std::shared_lock<std::shared_mutex> lock(shard.mutex);
+                keys += shard.records.size();
+            }
+            std::cout << "[KvDatabase] " << keys << " keys at timestamp " << timestamp() << std::endl;
+        }
+
+        void write(const std::string& data) const override {
+            write("data", data);
+        }
+
+        // Reads at the current watermark. If vacuum raced ahead of that
+        // watermark and cut the version it needed, a newer watermark is
+        // just as correct, so it retries with one.
+        std::optional<std::string> read(const std::string& key) const override {
+            EpochDomain::Guard guard = EpochDomain::instance().pin();
+            const Record* record = find(key);
+            if (!record) {
+                return std::nullopt;
+            }
+            while (true) {
+                std::uint64_t ts = visibleTs.load(std::memory_order_acquire);
+                if (const Version* v = versionAt(*record, ts)) {
+                    return v->value;
+                }
+                if (record->trimmedAt.load(std::memory_order_acquire) <= ts) {
+                    return std::nullopt;
+                }
+            }
+        }
+
+        void write(const std::string& key, const std::string& value) const override {
+            commit({{key, value}});
+        }
+
+        // One snapshot for the whole batch.
+        std::vector<std::optional<std::string>> readMany(
+            const std::vector<std::string>& keys) const override {
+            Snapshot view = snapshot();
+            std::vector<std::optional<std::string>> values;
+            values.reserve(keys.size());
+            for (const std::string& key : keys) {
+                values.push_back(view.read(key));
+            }
+            return values;
+        }
+
+        // Commits the batch atomically under one timestamp.
+        void writeMany(
+            const std::vector<std::pair<std::string, std::string>>& rows) const override {
+            if (!rows.empty()) {
+                commit(rows);
+            }
+        }
+
+        std::uint64_t timestamp() const { return visibleTs.load(std::memory_order_acquire); }
+
+        // Frees versions older than the newest one each open snapshot (and
+        // the watermark) can see. Returns how many were dropped.
+        std::size_t vacuum() {
+            std::uint64_t horizon;
+            {
+                std::lock_guard<std::mutex> lock(snapshotMutex);
+                horizon = visibleTs.load(std::memory_order_acquire);
+                if (!snapshots.empty()) {
+                    horizon = std::min(horizon, *snapshots.begin());
+                }
+            }
+            auto dropped = std::make_shared<std::vector<Version*>>();
+            for (Shard& shard : shards) {
+                std::shared_lock<std::shared_mutex> shardLock(shard.mutex);
+                for (auto& entry : shard.records) {
+                    Record& record = *entry.second;
+                    std::lock_guard<std::mutex> lock(record.writer);
+                    Version* keep = record.head.load(std::memory_order_relaxed);
+                    while (keep && keep->ts > horizon) {
+                        keep = keep->next.load(std::memory_order_relaxed);
+                    }
+                    Version* rest = keep ? keep->next.load(std::memory_order_relaxed) : nullptr;
+                    if (!rest) {
+                        continue;
+                    }
+                    record.trimmedAt.store(horizon, std::memory_order_release);
+                    keep->next.store(nullptr, std::memory_order_release);
+                    for (; rest; rest = rest->next.load(std::memory_order_relaxed)) {
+                        dropped->push_back(rest);
+                    }
+                }
+            }
+            std::size_t count = dropped->size();
+            if (count > 0) {
+                EpochDomain::instance().retire([dropped] {
+                    for (Version* v : *dropped) {
+                        delete v;
+                    }
+                });
+            }
+            return count;
+        }
+};
+
+// In-process stand-in for a remote database: a KvDatabase that sleeps for
+// `latency` on every call to model the round trip, and counts the calls that
+// reach it. A batch is one call.
+class InMemoryDatabase : public Database {
+    KvDatabase store;
+    std::chrono::microseconds latency;
+    mutable std::atomic<std::size_t> readCalls{0};
+    mutable std::atomic<std::size_t> writeCalls{0};
+
+    // At most `connections` round trips run at once; 0 means no limit.
+    std::size_t connections;
+    mutable std::mutex connectionMutex;
+    mutable std::condition_variable connectionFree;
+    mutable std::size_t connectionsInUse = 0;
+
+    void roundTrip() const {
+        if (latency.count() <= 0) {
+            return;
+        }
+        if (connections == 0) {
+            std::this_thread::sleep_for(latency);
+            return;
+        }
+        {
+            std::unique_lock<std::mutex> lock(connectionMutex);
+            connectionFree.wait(lock, [this] { return connectionsInUse < connections; });
+            ++connectionsInUse;
+        }
+        std::this_thread::sleep_for(latency);
+        {
+            std::lock_guard<std::mutex> lock(connectionMutex);
+            --connectionsInUse;
+        }
+        connectionFree.notify_one();
+    }
+
+    public:
+        explicit InMemoryDatabase(std::chrono::microseconds latency = std::chrono::microseconds(0),
+            std::size_t connections = 0, KvOptions options = {})
+            : store(std::move(options)), latency(latency), connections(connections) {}
+
+        void read() const override {
+            store.read();
+        }
+
+        void write(const std::string& data) const override {
+            write("data", data);
+        }
+
+        std::optional<std::string> read(const std::string& key) const override {
+            roundTrip();
+            ++readCalls;
+            return store.read(key);
+        }
+
+        void write(const std::string& key, const std::string& value) const override {
+            roundTrip();
+            ++writeCalls;
+            store.write(key, value);
+        }
+
+        std::vector<std::optional<std::string>> readMany(
+            const std::vector<std::string>& keys) const override {
+            roundTrip();
+            ++readCalls;
+            return store.readMany(keys);
+        }
+
+        void writeMany(
+            const std::vector<std::pair<std::string, std::string>>& batch) const override {
+            roundTrip();
+            ++writeCalls;
+            store.writeMany(batch);
+        }
+
+        std::size_t reads() const { return readCalls; }
+        std::size_t writes() const { return writeCalls; }
+};
+
+// WriteThrough finishes each write at the backend before returning.
+// WriteBehind acknowledges once the write is buffered; writes to the same
+// key coalesce and a background thread flushes them in batches, so a crash
+// loses up to one flush interval.
+enum class Durability {
+    WriteThrough,
+    WriteBehind
+};
+
+struct CacheOptions {
+    std::size_t shards = 16;
+    std::size_t entriesPerShard = 4096;
+    std::chrono::milliseconds ttl{1000};
+    std::chrono::milliseconds negativeTtl{100}; // how long "not found" is remembered
+    Durability durability = Durability::WriteBehind;
+    std::size_t flushBatch = 64;
+    std::chrono::milliseconds flushInterval{5};
+};
+
+// Read-through, write-behind caching proxy. Keyed reads are served from a
+// sharded LRU cache with TTLs, including cached misses; keyed writes go to
+// the backend as the Durability mode says. Reads always see writes that are
+// buffered or being flushed. A failed background flush keeps its writes
+// buffered for the next attempt and is reported by flush().
+class CachingDatabaseProxy : public Database {
+    using Clock = std::chrono::steady_clock;
+
+    // Keys in recency order, most recent first. They point at the keys in
+    // `entries`, whose nodes stay put until erased.
+    using Recency = std::list<const std::string*>;
+
+    struct Entry {
+        std::optional<std::string> value;
+        Clock::time_point expires;
+        Recency::iterator position;
+    };
+
+    // `writes` lets a read miss notice that a write to the shard raced with
+    // its backend read, and skip caching what may be an older value.
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_map<std::string, Entry> entries;
+        Recency recency;
+        std::uint64_t writes = 0;
+    };
+
+    std::shared_ptr<Database> backend;
+    CacheOptions options;
+    mutable std::vector<Shard> shards;
+
+    // Write-behind state. `inFlight` holds the batch the flusher is writing,
+    // so a read that misses the cache during a flush cannot see older data.
+    mutable std::mutex pendingMutex;
+    mutable std::condition_variable pendingReady;
+    std::condition_variable flushed;
+    mutable std::unordered_map<std::string, std::string> pending;
+    mutable std::unordered_map<std::string, std::string> inFlight;
+    bool flushWanted = false;
+    bool stopping = false;
+    std::exception_ptr flushError; // first failure since flush() last reported one
+    std::thread flusher;
+
+    mutable std::atomic<std::size_t> hitCount{0};
+    mutable std::atomic<std::size_t> negativeHitCount{0};
+    mutable std::atomic<std::size_t> missCount{0};
+    mutable std::atomic<std::size_t> coalescedCount{0};
+    mutable std::atomic<std::size_t> flushCount{0};
+
+    Shard& shardFor(const std::string& key) const {
+        return shards[std::hash<std::string>{}(key) % shards.size()];
+    }
+
+    // Caches `value` for `key`, evicting the shard's least recently used
+    // entry when it is full. A read fill passes the shard's write count from
+    // before its backend read and is dropped if a write came in since.
+    void remember(const std::string& key, std::optional<std::string> value,
+        const std::uint64_t* writesBeforeRead) const {
+        auto ttl = value ? options.ttl : options.negativeTtl;
+        Clock::time_point expires = Clock::now() + ttl;
+        Shard& shard = shardFor(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (writesBeforeRead && *writesBeforeRead != shard.writes) {
+            return;
+        }
+        if (!writesBeforeRead) {
+            ++shard.writes;
+        }
+        auto it = shard.entries.find(key);
+        if (it != shard.entries.end()) {
+            it->second.value = std::move(value);
+            it->second.expires = expires;
+            shard.recency.splice(shard.recency.begin(), shard.recency, it->second.position);
+            return;
+        }
+        if (shard.entries.size() >= std::max<std::size_t>(1, options.entriesPerShard)) {
+            shard.entries.erase(*shard.recency.back());
+            shard.recency.pop_back();
+        }
+        it = shard.entries.emplace(key, Entry{std::move(value), expires, {}}).first;
+        shard.recency.push_front(&it->first);
+        it->second.position = shard.recency.begin();
+    }
+
+    // Drops `key` from the cache and, like a write, turns away read fills
+    // that started before.
+    void forget(const std::string& key) const {
+        Shard& shard = shardFor(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        ++shard.writes;
+        auto it = shard.entries.find(key);
+        if (it != shard.entries.end()) {
+            shard.recency.erase(it->second.position);
+            shard.entries.erase(it);
+        }
+    }
+
+    std::optional<std::string> buffered(const std::string& key, bool& found) const {
+        std::lock_guard<std::mutex> lock(pendingMutex);
+        for (const auto* map : {&pending, &inFlight}) {
+            auto it = map->find(key);
+            if (it != map->end()) {
+                found = true;
+                return it->second;
+            }
+        }
+        found = false;
+        return std::nullopt;
+    }
+
+    // Serves `key` from the write buffer or the cache and counts the hit. On
+    // a miss, records the shard's write count for remember() instead.
+    bool lookup(const std::string& key, std::optional<std::string>& value,
+        std::uint64_t& writesBeforeRead) const {
+        bool found;
+        value = buffered(key, found);
+        if (found) {
+            ++hitCount;
+            return true;
+        }
+        Shard& shard = shardFor(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.entries.find(key);
+        if (it != shard.entries.end() && it->second.expires > Clock::now()) {
+            ++(it->second.value ? hitCount : negativeHitCount);
+            value = it->second.value;
+            shard.recency.splice(shard.recency.begin(), shard.recency, it->second.position);
+            return true;
+        }
+        writesBeforeRead = shard.writes;
+        ++missCount;
+        return false;
+    }
+
+    void flushLoop() {
+        std::unique_lock<std::mutex> lock(pendingMutex);
+        while (true) {
+            pendingReady.wait_for(lock, options.flushInterval, [this] {
+                return stopping || flushWanted || pending.size() >= options.flushBatch;
+            });
+            flushWanted = false;
+            if (!pending.empty()) {
+                inFlight.swap(pending);
+                std::vector<std::pair<std::string, std::string>> batch(
+                    inFlight.begin(), inFlight.end());
+                lock.unlock();
+                std::exception_ptr error;
+                try {
+                    for (std::size_t i = 0; i < batch.size(); i += options.flushBatch) {
+                        std::size_t end = std::min(batch.size(), i + options.flushBatch);
+                        backend->writeMany({batch.begin() + i, batch.begin() + end});
+                    }
+                } catch (...) {
+                    error = std::current_exception();
+                }
+                lock.lock();
+                if (error) {
+                    // Retry the batch later, except keys written again since.
+                    for (auto& [key, value] : inFlight) {
+                        pending.emplace(key, std::move(value));
+                    }
+                    if (!flushError) flushError = error;
+                }
+                inFlight.clear();
+                ++flushCount;
+                flushed.notify_all();
+                if (error && stopping) {
+                    return; // nobody is left to report it to; the writes are lost
+                }
+                if (error) {
+                    pendingReady.wait_for(lock, options.flushInterval, [this] { return stopping; });
+                }
+            } else if (stopping) {
+                return;
+            }
+        }
+    }
+
+    public:
+        CachingDatabaseProxy(std::shared_ptr<Database> backend, CacheOptions options = {})
+            : backend(std::move(backend)), options(options),
+              shards(std::max<std::size_t>(1, options.shards)) {
+            if (options.durability == Durability::WriteBehind) {
+                flusher = std::thread([this] { flushLoop(); });
+            }
+        }
+
+        ~CachingDatabaseProxy() override {
+            if (flusher.joinable()) {
+                {
+                    std::lock_guard<std::mutex> lock(pendingMutex);
+                    stopping = true;
+                }
+                pendingReady.notify_one();
+                flusher.join();
+            }
+        }
+
+        void read() const override { backend->read(); }
+        void write(const std::string& data) const override { backend->write(data); }
+
+        std::optional<std::string> read(const std::string& key) const override {
+            std::optional<std::string> value;
+            std::uint64_t writesBeforeRead;
+            if (lookup(key, value, writesBeforeRead)) {
+                return value;
+            }
+            value = backend->read(key);
+            remember(key, value, &writesBeforeRead);
+            return value;
+        }
+
+        // Misses go to the backend together as one readMany.
+        std::vector<std::optional<std::string>> readMany(
+            const std::vector<std::string>& keys) const override {
+            std::vector<std::optional<std::string>> values(keys.size());
+            std::vector<std::size_t> missing;
+            std::vector<std::string> missingKeys;
+            std::vector<std::uint64_t> writesBeforeRead;
+            for (std::size_t i = 0; i < keys.size(); ++i) {
+                std::uint64_t writes;
+                if (!lookup(keys[i], values[i], writes)) {
+                    missing.push_back(i);
+                    missingKeys.push_back(keys[i]);
+                    writesBeforeRead.push_back(writes);
+                }
+            }
+            if (missing.empty()) {
+                return values;
+            }
+            std::vector<std::optional<std::string>> fetched = backend->readMany(missingKeys);
+            for (std::size_t j = 0; j < missing.size(); ++j) {
+                values[missing[j]] = fetched[j];
+                remember(missingKeys[j], std::move(fetched[j]), &writesBeforeRead[j]);
+            }
+            return values;
+        }
+
+        void write(const std::string& key, const std::string& value) const override {
+            if (options.durability == Durability::WriteThrough) {
+                // Invalidate rather than fill: racing writers may reach the
+                // backend in either order, and the next read fetches the winner.
+                backend->write(key, value);
+                forget(key);
+                return;
+            }
+            std::size_t queued;
+            {
+                // Updating the cache under pendingMutex keeps it in the same
+                // order as the buffer when writers race on a key.
+                std::lock_guard<std::mutex> lock(pendingMutex);
+                remember(key, value, nullptr);
+                coalescedCount += !pending.insert_or_assign(key, value).second;
+                queued = pending.size();
+            }
+            if (queued >= options.flushBatch) {
+                pendingReady.notify_one();
+            }
+        }
+
+        // Blocks until every write buffered before the call reached the backend.
+        // Rethrows a background flush failure; the failed writes stay buffered
+        // and are retried.
+        void flush() {
+            std::unique_lock<std::mutex> lock(pendingMutex);
+            if (!pending.empty() || !inFlight.empty()) {
+                std::size_t target = flushCount + (pending.empty() ? 1 : 1 + !inFlight.empty());
+                flushWanted = true;
+                pendingReady.notify_one();
+                flushed.wait(lock, [&] { return flushCount >= target || flushError; });
+            }
+            if (flushError) {
+                std::rethrow_exception(std::exchange(flushError, nullptr));
+            }
+        }
+
+        struct Stats {
+            std::size_t hits;
+            std::size_t negativeHits;
+            std::size_t misses;
+            std::size_t coalesced; // writes absorbed by a later write to the same key
+            std::size_t flushes;
+        };
+
+        Stats stats() const {
+            return {hitCount, negativeHitCount, missCount, coalescedCount, flushCount};
+        }
+};
+
+struct BatchOptions {
+    std::size_t maxBatch = 128;
+    // The gathering window is a fraction of the observed round trip,
+    // clamped to [minWindow, maxWindow].
+    double windowFraction = 0.25;
+    std::chrono::microseconds minWindow{10};
+    std::chrono::microseconds maxWindow{2000};
+    unsigned pipelineDepth = 2; // batches that may be in flight at once
+};
+
+// Micro-batching proxy. Keyed operations from concurrent callers are queued
+// and sent to the backend together as readMany/writeMany, and each caller
+// gets its result through a future. A batch goes out once it is full or its
+// gathering window closes. The window follows the measured batch latency:
+// waiting a quarter of a round trip for company is cheap next to taking a
+// round trip alone. It collapses to minWindow while batches come back with
+// a single operation, so a lone caller is not delayed. Up to pipelineDepth
+// batches are in flight at once. Operations in the same batch keep their
+// order; across batches only a completed future orders them.
+class BatchingDatabaseProxy : public Database {
+    using Clock = std::chrono::steady_clock;
+
+    struct Op {
+        bool isWrite;
+        std::string key;
+        std::string value;
+        std::promise<std::optional<std::string>> readResult;
+        std::promise<void> writeResult;
+    };
+
+    std::shared_ptr<Database> backend;
+    BatchOptions options;
+
+    mutable std::mutex mutex;
+    mutable std::condition_variable ready;
+    mutable std::deque<Op> queue;
+    bool stopping = false;
+    std::vector<std::thread> senders;
+
+    std::atomic<std::int64_t> latencyNs{0}; // moving average of batch round trips
+    std::atomic<std::size_t> lastBatchSize{0};
+    std::atomic<std::size_t> batchCount{0};
+    std::atomic<std::size_t> opCount{0};
+
+    std::chrono::nanoseconds window() const {
+        if (lastBatchSize.load(std::memory_order_relaxed) <= 1) {
+            return options.minWindow;
+        }
+        auto wanted = std::chrono::nanoseconds(std::int64_t(
+            double(latencyNs.load(std::memory_order_relaxed)) * options.windowFraction));
+        return std::clamp<std::chrono::nanoseconds>(wanted, options.minWindow, options.maxWindow);
+    }
+
+    void senderLoop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            ready.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (queue.empty()) {
+                return;
+            }
+            ready.wait_until(lock, Clock::now() + window(), [this] {
+                return stopping || queue.size() >= options.maxBatch;
+            });
+            std::size_t take = std::min(queue.size(), options.maxBatch);
+            std::vector<Op> batch(std::make_move_iterator(queue.begin()),
+                std::make_move_iterator(queue.begin() + take));
+            queue.erase(queue.begin(), queue.begin() + take);
+            if (!queue.empty()) {
+                ready.notify_one(); // let another sender pipeline the rest
+            }
+            lock.unlock();
+            send(batch);
+            lock.lock();
+        }
+    }
+
+    // Sends each run of reads or writes as one call, keeping their order.
+    // The batch is counted before any of its results is set, so a caller
+    // whose future is ready also sees its operation in stats().
+    void send(std::vector<Op>& batch) {
+        ++batchCount;
+        opCount += batch.size();
+        auto start = Clock::now();
+        for (std::size_t begin = 0; begin < batch.size();) {
+            std::size_t end = begin;
+            while (end < batch.size() && batch[end].isWrite == batch[begin].isWrite) {
+                ++end;
+            }
+            try {
+                if (batch[begin].isWrite) {
+                    std::vector<std::pair<std::string, std::string>> rows;
+                    for (std::size_t i = begin; i < end; ++i) {
+                        rows.emplace_back(std::move(batch[i].key), std::move(batch[i].value));
+                    }
+                    backend->writeMany(rows);
+                    for (std::size_t i = begin; i < end; ++i) {
+                        batch[i].writeResult.set_value();
+                    }
+                } else {
+                    std::vector<std::string> keys;
+                    for (std::size_t i = begin; i < end; ++i) {
+                        keys.push_back(std::move(batch[i].key));
+                    }
+                    std::vector<std::optional<std::string>> values = backend->readMany(keys);
+                    for (std::size_t i = begin; i < end; ++i) {
+                        batch[i].readResult.set_value(std::move(values[i - begin]));
+                    }
+                }
+            } catch (...) {
+                for (std::size_t i = begin; i < end; ++i) {
+                    if (batch[i].isWrite) {
+                        batch[i].writeResult.set_exception(std::current_exception());
+                    } else {
+                        batch[i].readResult.set_exception(std::current_exception());
+                    }
+                }
+            }
+            begin = end;
+        }
+        std::int64_t sample = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            Clock::now() - start).count();
+        std::int64_t average = latencyNs.load(std::memory_order_relaxed);
+        latencyNs.store(average == 0 ? sample : average + (sample - average) / 8,
+            std::memory_order_relaxed);
+        lastBatchSize.store(batch.size(), std::memory_order_relaxed);
+    }
+
+    void enqueue(Op op) const {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queue.push_back(std::move(op));
+        }
+        ready.notify_one();
+    }
+
+    public:
+        BatchingDatabaseProxy(std::shared_ptr<Database> backend, BatchOptions options = {})
+            : backend(std::move(backend)), options(options) {
+            for (unsigned i = 0; i < std::max(1u, options.pipelineDepth); ++i) {
+                senders.emplace_back([this] { senderLoop(); });
+            }
+        }
+
+        // Operations already queued are still sent.
+        ~BatchingDatabaseProxy() override {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            ready.notify_all();
+            for (std::thread& sender : senders) {
+                sender.join();
+            }
+        }
+
+        std::future<std::optional<std::string>> readAsync(const std::string& key) const {
+            Op op{false, key, {}, {}, {}};
+            auto result = op.readResult.get_future();
+            enqueue(std::move(op));
+            return result;
+        }
+
+        std::future<void> writeAsync(const std::string& key, const std::string& value) const {
+            Op op{true, key, value, {}, {}};
+            auto result = op.writeResult.get_future();
+            enqueue(std::move(op));
+            return result;
+        }
+
+        void read() const override { backend->read(); }
+        void write(const std::string& data) const override { backend->write(data); }
+
+        std::optional<std::string> read(const std::string& key) const override {
+            return readAsync(key).get();
+        }
+
+        void write(const std::string& key, const std::string& value) const override {
+            writeAsync(key, value).get();
+        }
+
+        // A caller's own batch already amortises the round trip.
+        std::vector<std::optional<std::string>> readMany(
+            const std::vector<std::string>& keys) const override {
+            return backend->readMany(keys);
+        }
+
+        void writeMany(
+            const std::vector<std::pair<std::string, std::string>>& rows) const override {
+            backend->writeMany(rows);
+        }
+
+        struct Stats {
+            std::size_t batches;
+            std::size_t operations;
+            std::chrono::nanoseconds window; // current gathering window
+        };
+
+        Stats stats() const { return {batchCount, opCount, window()}; }
+};
+
+// Times PolicyEngine::allows() on `threads` threads while another thread
+// keeps reloading the policy.
+void runAuthorizationBenchmark(unsigned threads, std::size_t checksPerThread) {
+    std::vector<PolicyRule> rules = {
+        {Role::Admin, "*", Operation::Read}, {Role::Admin, "*", Operation::Write},
+        {Role::Analyst, "*", Operation::Read},
+    };
+    std::vector<std::string> tables;
+    for (int i = 0; i < 64; ++i) {
+        tables.push_back("table" + std::to_string(i));
+        rules.push_back({Role::Editor, tables.back(), Operation::Write, i % 2 == 0});
+    }
+    PolicyEngine engine(rules);
+    std::vector<ResourceId> ids;
+    for (const std::string& t : tables) {
+        ids.push_back(engine.resource(t));
+    }
+
+    std::atomic<bool> done{false};
+    std::size_t reloads = 0;
+    std::thread reloader([&] {
+        while (!done.load(std::memory_order_relaxed)) {
+            engine.reload(rules);
+            ++reloads;
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    });
+
+    std::atomic<std::size_t> granted{0};
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+            std::size_t local = 0;
+            for (std::size_t i = 0; i < checksPerThread; ++i) {
+                Role role = Role(i % kRoleCount);
+                Operation op = Operation((i >> 2) % kOperationCount);
+                local += engine.allows(role, ids[(i + t) % ids.size()], op);
+            }
+            granted += local;
+        });
+    }
+    for (std::thread& w : workers) {
+        w.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    done = true;
+    reloader.join();
+
+    std::size_t checks = threads * checksPerThread;
+    std::cout << checks << " checks on " << threads << " threads: "
+        << seconds * 1e9 * threads / double(checks) << " ns per check, "
+        << double(checks) / seconds / 1e6 << "M checks/s, " << reloads
+        << " reloads, " << granted.load() << " granted" << std::endl;
+}
+
+// Mixed load of repeat reads and hot-key writes against a slow stand-in,
+// direct and through the caching proxy in both durability modes.
+void runCacheBenchmark(unsigned threads, std::size_t opsPerThread) {
+    auto run = [&](const char* label, bool cached, Durability durability) {
+        auto backend = std::make_shared<InMemoryDatabase>(std::chrono::microseconds(50));
+        std::shared_ptr<Database> db = backend;
+        std::shared_ptr<CachingDatabaseProxy> cache;
+        if (cached) {
+            CacheOptions options;
+            options.durability = durability;
+            cache = std::make_shared<CachingDatabaseProxy>(backend, options);
+            db = cache;
+        }
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> workers;
+        for (unsigned t = 0; t < threads; ++t) {
+            workers.emplace_back([&, t] {
+                std::uint32_t x = 2463534242u + t;
+                for (std::size_t i = 0; i < opsPerThread; ++i) {
+                    x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+                    if (x % 10 == 0) {
+                        db->write("key" + std::to_string(x % 100), std::to_string(i));
+                    } else {
+                        db->read("key" + std::to_string(x % 1000));
+                    }
+                }
+            });
+        }
+        for (std::thread& w : workers) {
+            w.join();
+        }
+        if (cache) {
+            cache->flush();
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << label << ": " << double(threads * opsPerThread) / seconds << " ops/s, backend reads "
+            << backend->reads() << ", backend writes " << backend->writes() << std::endl;
+    };
+    run("Direct       ", false, Durability::WriteThrough);
+    run("WriteThrough ", true, Durability::WriteThrough);
+    run("WriteBehind  ", true, Durability::WriteBehind);
+}
+
+// Many small keyed operations from concurrent callers against a stand-in
+// with a 200 us round trip over two connections, direct and through the
+// batching proxy (which pipelines two batches).
+void runBatchingBenchmark(unsigned threads, std::size_t opsPerThread) {
+    auto run = [&](const char* label, bool batched) {
+        auto backend = std::make_shared<InMemoryDatabase>(std::chrono::microseconds(200), 2);
+        std::shared_ptr<Database> db = backend;
+        if (batched) {
+            db = std::make_shared<BatchingDatabaseProxy>(backend);
+        }
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> workers;
+        for (unsigned t = 0; t < threads; ++t) {
+            workers.emplace_back([&, t] {
+                for (std::size_t i = 0; i < opsPerThread; ++i) {
+                    std::string key = "key" + std::to_string((t * 31 + i) % 500);
+                    if (i % 4 == 0) {
+                        db->write(key, std::to_string(i));
+                    } else {
+                        db->read(key);
+                    }
+                }
+            });
+        }
+        for (std::thread& w : workers) {
+            w.join();
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << label << ": " << double(threads * opsPerThread) / seconds
+            << " ops/s, round trips " << backend->reads() + backend->writes() << std::endl;
+    };
+    run("Direct ", false);
+    run("Batched", true);
+}
+
+// Load generator for KvDatabase: reads and writes per second by thread
+// count over a preloaded key space, with and without the write-ahead log.
+void runEngineBenchmark(std::size_t opsPerThread) {
+    const std::size_t keys = 100000;
+    std::string walPath = (std::filesystem::temp_directory_path() / "kv_bench.wal").string();
+    auto throughput = [&](const KvDatabase& db, unsigned threads, bool writes) {
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> workers;
+        for (unsigned t = 0; t < threads; ++t) {
+            workers.emplace_back([&, t] {
+                std::uint32_t x = 2463534242u + t;
+                for (std::size_t i = 0; i < opsPerThread; ++i) {
+                    x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+                    std::string key = "key" + std::to_string(x % keys);
+                    if (writes) {
+                        db.write(key, std::to_string(i));
+                    } else {
+                        db.read(key);
+                    }
+                }
+            });
+        }
+        for (std::thread& w : workers) {
+            w.join();
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return double(threads * opsPerThread) / seconds;
+    };
+
+    std::cout << "threads  reads/s  writes/s  writes/s (WAL)" << std::endl;
+    for (unsigned threads : {1u, 2u, 4u, 8u}) {
+        KvDatabase memory;
+        std::filesystem::remove(walPath);
+        KvOptions logged;
+        logged.walPath = walPath;
+        KvDatabase durable(logged);
+        std::vector<std::pair<std::string, std::string>> preload;
+        for (std::size_t k = 0; k < keys; ++k) {
+            preload.emplace_back("key" + std::to_string(k), "value");
+        }
+        memory.writeMany(preload);
+        double reads = throughput(memory, threads, false);
+        double writes = throughput(memory, threads, true);
+        double loggedWrites = throughput(durable, threads, true);
+        memory.vacuum();
+        std::cout << threads << "  " << std::size_t(reads) << "  " << std::size_t(writes)
+            << "  " << std::size_t(loggedWrites) << std::endl;
+    }
+    std::filesystem::remove(walPath);
+}
+
+// How to compile - g++ -std=c++17 -pthread database_proxy_pattern.cpp
+// Run "./a.out bench" to time authorization checks under policy reloads, the
+// caching and batching proxies against a slow stand-in database, and the
+// KvDatabase engine by thread count.
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && std::string(argv[1]) == "bench") {
+        unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+        runAuthorizationBenchmark(threads, 20000000 / threads);
+        runCacheBenchmark(4, 5000);
+        runBatchingBenchmark(32, 200);
+        runEngineBenchmark(200000);
+        return 0;
+    }
+
+    auto policy = std::make_shared<PolicyEngine>(std::vector<PolicyRule>{
+        {Role::Guest, "articles", Operation::Read},
+        {Role::Analyst, "*", Operation::Read},
+        {Role::Editor, "articles", Operation::Read},
+        {Role::Editor, "articles", Operation::Write},
+        {Role::Admin, "*", Operation::Read},
+        {Role::Admin, "*", Operation::Write},
+    });
+
+    DatabaseProxy *db1 = new DatabaseProxy(policy, Role::Guest, "articles");
     db1->read();
     db1->write("Guest trying to write");
 
     std::cout << "\n--- Admin User ---\n";
-    Database* adminDb = new DatabaseProxy(Role::Admin);
+    Database* adminDb = new DatabaseProxy(policy, Role::Admin, "users");
     adminDb->read();
     adminDb->write("Admin update");
 
     delete db1;
     delete adminDb;
+
+    std::cout << "\n--- Per-table rules ---\n";
+    DatabaseProxy analyst(policy, Role::Analyst, "payments");
+    DatabaseProxy editor(policy, Role::Editor, "articles");
+    DatabaseProxy guest(policy, Role::Guest, "payments");
+    analyst.read();
+    analyst.write("Analyst trying to write");
+    editor.write("Editor update");
+    guest.read();
+
+    std::cout << "\n--- Policy reload (editors lose write access) ---\n";
+    policy->reload({
+        {Role::Guest, "articles", Operation::Read},
+        {Role::Analyst, "*", Operation::Read},
+        {Role::Editor, "articles", Operation::Read},
+        {Role::Admin, "*", Operation::Read},
+        {Role::Admin, "*", Operation::Write},
+    });
+    std::cout << "Policy version " << policy->version() << std::endl;
+    editor.write("Editor update");
+    editor.read();
+
+    std::cout << "\n--- Caching proxy (write-behind) ---\n";
+    auto standIn = std::make_shared<InMemoryDatabase>(std::chrono::milliseconds(2));
+    standIn->write("article:1", "Proxy pattern");
+    CacheOptions demoOptions;
+    demoOptions.flushInterval = std::chrono::milliseconds(1000); // flush only when asked
+    auto cache = std::make_shared<CachingDatabaseProxy>(standIn, demoOptions);
+    DatabaseProxy reader(policy, Role::Guest, "articles", cache);
+    for (int i = 0; i < 5; ++i) {
+        reader.read("article:1");        // one backend read, then cache hits
+        reader.read("article:404");      // a cached miss
+    }
+    DatabaseProxy writer(policy, Role::Admin, "articles", cache);
+    for (int i = 1; i <= 10; ++i) {
+        writer.write("article:2", "draft " + std::to_string(i)); // coalesced
+    }
+    std::cout << "Before flush: " << reader.read("article:2").value_or("-") << " (backend has "
+        << standIn->read("article:2").value_or("nothing") << ")" << std::endl;
+    cache->flush();
+    CachingDatabaseProxy::Stats cacheStats = cache->stats();
+    std::cout << "Hits: " << cacheStats.hits << ", negative hits: " << cacheStats.negativeHits
+        << ", misses: " << cacheStats.misses << ", coalesced writes: " << cacheStats.coalesced
+        << std::endl;
+    std::cout << "Backend reads: " << standIn->reads() << ", backend writes: "
+        << standIn->writes() << std::endl;
+
+    std::cout << "\n--- MVCC key-value engine with a write-ahead log ---\n";
+    std::string walPath = (std::filesystem::temp_directory_path() / "kv_demo.wal").string();
+    std::filesystem::remove(walPath);
+    {
+        KvOptions logged;
+        logged.walPath = walPath;
+        KvDatabase kv(logged);
+        kv.writeMany({{"stock:apples", "10"}, {"stock:pears", "4"}});
+        KvDatabase::Snapshot before = kv.snapshot();
+        kv.write("stock:apples", "7");
+        kv.write("stock:apples", "3");
+        std::cout << "Snapshot at " << before.timestamp() << " sees " << *before.read("stock:apples")
+            << " apples, now " << *kv.read("stock:apples") << std::endl;
+        std::cout << "Vacuum with the snapshot open dropped " << kv.vacuum() << " versions";
+        { KvDatabase::Snapshot released = std::move(before); }
+        std::cout << ", after it closed " << kv.vacuum() << std::endl;
+    }
+    {
+        KvOptions logged;
+        logged.walPath = walPath;
+        KvDatabase recovered(logged);
+        std::cout << "Recovered from the log: " << *recovered.read("stock:apples") << " apples, "
+            << *recovered.read("stock:pears") << " pears" << std::endl;
+        recovered.read();
+    }
+    std::filesystem::remove(walPath);
+
+    std::cout << "\n--- Batching proxy ---\n";
+    auto remote = std::make_shared<InMemoryDatabase>(std::chrono::milliseconds(1));
+    {
+        BatchingDatabaseProxy batcher(remote);
+        std::vector<std::future<void>> writes;
+        for (int i = 0; i < 50; ++i) {
+            writes.push_back(batcher.writeAsync("row:" + std::to_string(i), std::to_string(i * i)));
+        }
+        for (auto& w : writes) {
+            w.get();
+        }
+        std::vector<std::thread> callers;
+        std::atomic<int> sum{0};
+        for (int t = 0; t < 8; ++t) {
+            callers.emplace_back([&, t] {
+                for (int i = t; i < 50; i += 8) {
+                    sum += std::stoi(batcher.read("row:" + std::to_string(i)).value_or("0"));
+                }
+            });
+        }
+        for (std::thread& c : callers) {
+            c.join();
+        }
+        BatchingDatabaseProxy::Stats batchStats = batcher.stats();
+        std::cout << "Sum of squares: " << sum << ", " << batchStats.operations
+            << " operations in " << batchStats.batches << " batches" << std::endl;
+    }
     return 0;
-    return 0;
-}
\ No newline at end of file
+}
@@ -20,6 +20,10 @@
 // Makes your code open for extension, but closed for modification (OCP from SOLID).
 
 #include<iostream>
+#include<memory>
+#include<vector>
+#include<string>
+#include<chrono>
 
 class Notification {
 public:
@@ -41,9 +45,40 @@ class EmailNotification : public Notification {
         }
 };
 
+// Many notifications of one concrete type, made by a single factory call.
+// Sending the batch is one virtual call instead of one per notification.
+class NotificationBatch {
+    public:
+        virtual std::size_t size() const = 0;
+        virtual Notification& operator[](std::size_t i) = 0;
+        virtual void notifyAll() = 0;
+        virtual ~NotificationBatch() = default;
+};
+
+// Stores the notifications by value in one vector: one allocation for the
+// whole batch. Each item is exactly a T, so notifyAll() calls
+// T::notifyUser() directly.
+template<typename T>
+class NotificationBatchOf final : public NotificationBatch {
+    std::vector<T> items;
+
+    public:
+        explicit NotificationBatchOf(std::size_t count) : items(count) {}
+
+        std::size_t size() const override { return items.size(); }
+        T& operator[](std::size_t i) override { return items[i]; }
+
+        void notifyAll() override {
+            for (T& item : items) {
+                item.T::notifyUser();
+            }
+        }
+};
+
 class NotificationFactory {
     public:
         virtual std::unique_ptr<Notification> createNotification() = 0;
+        virtual std::unique_ptr<NotificationBatch> createMany(std::size_t count) = 0;
         virtual ~NotificationFactory() = default;
 };
 
@@ -52,6 +87,10 @@ class SMSNotificationFactory : public NotificationFactory {
         std::unique_ptr<Notification> createNotification() override {
             return std::make_unique<SMSNotification>();
         }
+
+        std::unique_ptr<NotificationBatch> createMany(std::size_t count) override {
+            return std::make_unique<NotificationBatchOf<SMSNotification>>(count);
+        }
 };
 
 class EmailNotificationFactory : public NotificationFactory {
@@ -59,6 +98,10 @@ class EmailNotificationFactory : public NotificationFactory {
         std::unique_ptr<Notification> createNotification() override {
             return std::make_unique<EmailNotification>();
         }
+
+        std::unique_ptr<NotificationBatch> createMany(std::size_t count) override {
+            return std::make_unique<NotificationBatchOf<EmailNotification>>(count);
+        }
 };
 
 void clientCode(NotificationFactory& factory) {
@@ -66,12 +109,59 @@ void clientCode(NotificationFactory& factory) {
     notification->notifyUser();
 }
 
-int main() {
+void clientCode(NotificationFactory& factory, std::size_t count) {
+    std::unique_ptr<NotificationBatch> batch = factory.createMany(count);
+    batch->notifyAll();
+}
+
+// Builds and sends batches of 10k e-mails one at a time and in bulk. Output
+// is switched off so the timing is the factory and dispatch work.
+void runBenchmark(std::size_t batches, std::size_t batchSize) {
+    EmailNotificationFactory factory;
+    using Clock = std::chrono::steady_clock;
+    std::cout.setstate(std::ios::badbit);
+
+    auto start = Clock::now();
+    for (std::size_t b = 0; b < batches; ++b) {
+        std::vector<std::unique_ptr<Notification>> notifications;
+        notifications.reserve(batchSize);
+        for (std::size_t i = 0; i < batchSize; ++i) {
+            notifications.push_back(factory.createNotification());
+        }
+        for (auto& notification : notifications) {
+            notification->notifyUser();
+        }
+    }
+    double singleMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+    start = Clock::now();
+    for (std::size_t b = 0; b < batches; ++b) {
+        clientCode(factory, batchSize);
+    }
+    double bulkMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+    std::cout.clear();
+    std::cout << batches << " batches of " << batchSize << ": one at a time " << singleMs
+        << " ms, createMany " << bulkMs << " ms" << std::endl;
+}
+
+// How to compile - g++ -std=c++17 factory_pattern.cpp
+// Run "./a.out bench" to compare createNotification() in a loop with createMany().
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && std::string(argv[1]) == "bench") {
+        runBenchmark(100, 10000);
+        return 0;
+    }
+
     SMSNotificationFactory smsNotificationFactory;
     EmailNotificationFactory emailNotificationFactory;
 
     clientCode(smsNotificationFactory);
     clientCode(emailNotificationFactory);
 
+    std::cout << "\n--- Bulk ---\n";
+    clientCode(emailNotificationFactory, 3);
+
     return 0;
 }
@@ -1,8 +1,30 @@
 #include<iostream>
 #include<functional>
+#include<memory>
+#include<string>
+#include<string_view>
+#include<unordered_map>
+#include<vector>
+#include<algorithm>
+#include<stdexcept>
+#include<chrono>
+#include<cstdint>
+#include<cstddef>
+#include<new>
+#include<tuple>
+#include<atomic>
+#include<mutex>
+#include<thread>
+#include<limits>
+#include<utility>
 
 using namespace std;
 
+// How to compile - g++ -std=c++17 -pthread factory_registor.cpp
+// Run "./a.out bench" to compare perfect-hash and arena-backed creation with
+// the unordered_map and make_unique path, and to time creation while a
+// plugin registers and unregisters shapes.
+
 // Base class
 class Shape {
     public:
@@ -13,6 +35,8 @@ class Shape {
 // Concrete class 
 class Circle : public Shape {
     public:
+        static constexpr string_view name = "circle";
+
         void draw () override {
             cout << "Drawing circle" << endl;             
         }
@@ -20,45 +44,715 @@ class Circle : public Shape {
 
 class Square : public Shape {
     public:
+        static constexpr string_view name = "square";
+
         void draw() override {
             cout << "Drawing square" << endl;
          }
 };
 
+class Triangle : public Shape {
+    public:
+        static constexpr string_view name = "triangle";
+
+        void draw() override {
+            cout << "Drawing triangle" << endl;
+        }
+};
+
+// Bump allocator for shapes made in bulk, e.g. one per frame. Objects are
+// placed back to back in large blocks and destroyed together by reset().
+class ShapeArena {
+    static constexpr size_t kBlockSize = size_t(1) << 20;
+
+    vector<unique_ptr<byte[]>> blocks;
+    size_t firstBlockSize = 0;
+    byte* cursor = nullptr;
+    byte* end = nullptr;
+    vector<Shape*> live;
+
+    public:
+        ShapeArena() = default;
+        ShapeArena(const ShapeArena&) = delete;
+        ShapeArena& operator=(const ShapeArena&) = delete;
+        ~ShapeArena() { reset(); }
+
+        void* allocate(size_t size, size_t align) {
+            auto aligned = [&](byte* p) {
+                return reinterpret_cast<byte*>(
+                    (reinterpret_cast<uintptr_t>(p) + align - 1) & ~uintptr_t(align - 1));
+            };
+            byte* p = cursor ? aligned(cursor) : nullptr;
+            if (!p || p + size > end) {
+                size_t blockSize = max(kBlockSize, size + align);
+                blocks.emplace_back(new byte[blockSize]);
+                if (blocks.size() == 1) {
+                    firstBlockSize = blockSize;
+                }
+                cursor = blocks.back().get();
+                end = cursor + blockSize;
+                p = aligned(cursor);
+            }
+            cursor = p + size;
+            return p;
+        }
+
+        // Registers an object constructed in this arena for destruction.
+        Shape* adopt(Shape* shape) {
+            live.push_back(shape);
+            return shape;
+        }
+
+        size_t size() const { return live.size(); }
+
+        // Destroys every shape and keeps the first block for reuse.
+        void reset() {
+            for (Shape* shape : live) {
+                shape->~Shape();
+            }
+            live.clear();
+            if (!blocks.empty()) {
+                blocks.resize(1);
+                cursor = blocks.front().get();
+                end = cursor + firstBlockSize;
+            }
+        }
+};
+
+// How to make one kind of shape, as plain function pointers.
+struct ShapeType {
+    unique_ptr<Shape> (*create)();
+    Shape* (*constructAt)(void* storage);
+    size_t size;
+    size_t align;
+
+    template<typename T>
+    static ShapeType of() {
+        return {
+            []() -> unique_ptr<Shape> { return make_unique<T>(); },
+            [](void* storage) -> Shape* { return new (storage) T(); },
+            sizeof(T),
+            alignof(T)
+        };
+    }
+};
+
+// Minimal perfect hash over a fixed set of names (hash and displace). Names
+// are spread over buckets by one hash; each bucket then gets the first seed
+// that sends all of its names to free slots. A lookup is two hashes, one
+// string compare and no allocation.
+class PerfectHashTable {
+    struct Slot {
+        string name;
+        ShapeType type{};
+    };
+
+    vector<uint32_t> seeds;
+    vector<Slot> slots;
+
+    static uint64_t hash(string_view key, uint64_t seed) {
+        uint64_t h = 14695981039346656037ull ^ (seed * 0x9E3779B97F4A7C15ull);
+        for (unsigned char c : key) {
+            h = (h ^ c) * 1099511628211ull;
+        }
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdull;
+        h ^= h >> 33;
+        return h;
+    }
+
+    public:
+        PerfectHashTable() = default;
+
+        explicit PerfectHashTable(const unordered_map<string, ShapeType>& entries)
+            : seeds(max<size_t>(1, entries.size() / 2 + 1), 0), slots(entries.size()) {
+            size_t n = slots.size();
+            vector<vector<const pair<const string, ShapeType>*>> buckets(seeds.size());
+            for (const auto& entry : entries) {
+                buckets[hash(entry.first, 0) % buckets.size()].push_back(&entry);
+            }
+            vector<size_t> order(buckets.size());
+            for (size_t i = 0; i < order.size(); ++i) {
+                order[i] = i;
+            }
+            // Place the largest buckets first, while the table is still empty.
+            sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+                return buckets[a].size() > buckets[b].size();
+            });
+
+            vector<bool> taken(n, false);
+            vector<size_t> placed;
+            for (size_t b : order) {
+                if (buckets[b].empty()) {
+                    continue;
+                }
+                for (uint32_t seed = 1;; ++seed) {
+                    placed.clear();
+                    for (const auto* entry : buckets[b]) {
+                        size_t slot = hash(entry->first, seed) % n;
+                        if (taken[slot] || std::find(placed.begin(), placed.end(), slot) != placed.end()) {
+                            break;
+                        }
+                        placed.push_back(slot);
+                    }
+                    if (placed.size() == buckets[b].size()) {
+                        seeds[b] = seed;
+                        for (size_t i = 0; i < placed.size(); ++i) {
+                            taken[placed[i]] = true;
+                            slots[placed[i]] = {buckets[b][i]->first, buckets[b][i]->second};
+                        }
+                        break;
+                    }
+                }
+            }
+        }
+
+        const ShapeType* find(string_view name) const {
+            if (slots.empty()) {
+                return nullptr;
+            }
+            uint32_t seed = seeds[hash(name, 0) % seeds.size()];
+            const Slot& slot = slots[hash(name, seed) % slots.size()];
+            return slot.name == name ? &slot.type : nullptr;
+        }
+};
+
+// Epoch-based reclamation for the factory's published catalog. A reader pins
+// the current epoch in its thread's slot for the length of one lookup, which
+// is a store and a load and never waits. Writers retire the catalog they
+// replaced, and it is freed once every pinned reader has moved past the
+// epoch it was retired in. This is the EpochDomain from
+// database_proxy_pattern.cpp; each example here builds on its own, so it is
+// repeated rather than shared.
+class EpochDomain {
+    static constexpr uint64_t kIdle = numeric_limits<uint64_t>::max();
+
+    struct Slot {
+        atomic<uint64_t> epoch{kIdle};
+        atomic<bool> inUse{false};
+        Slot* next = nullptr;
+    };
+
+    // Hands a slot to the thread for its lifetime and back to the list on exit.
+    struct Lease {
+        Slot* slot;
+        explicit Lease(EpochDomain& domain) : slot(domain.acquireSlot()) {}
+        ~Lease() { slot->inUse.store(false, memory_order_release); }
+    };
+
+    atomic<uint64_t> globalEpoch{1};
+    atomic<Slot*> slots{nullptr};
+    mutex retireMutex;
+    vector<pair<uint64_t, function<void()>>> retired;
+
+    EpochDomain() = default;
+
+    Slot* acquireSlot() {
+        for (Slot* s = slots.load(memory_order_acquire); s; s = s->next) {
+            bool expected = false;
+            if (!s->inUse.load(memory_order_relaxed) &&
+                s->inUse.compare_exchange_strong(expected, true)) {
+                return s;
+            }
+        }
+        Slot* s = new Slot;
+        s->inUse.store(true, memory_order_relaxed);
+        s->next = slots.load(memory_order_relaxed);
+        while (!slots.compare_exchange_weak(s->next, s)) {
+        }
+        return s;
+    }
+
+    Slot* localSlot() {
+        thread_local Lease lease(*this);
+        return lease.slot;
+    }
+
+    void reclaimLocked() {
+        uint64_t oldest = kIdle;
+        for (Slot* s = slots.load(memory_order_acquire); s; s = s->next) {
+            oldest = min(oldest, s->epoch.load());
+        }
+        auto kept = retired.begin();
+        for (auto it = retired.begin(); it != retired.end(); ++it) {
+            if (it->first < oldest) {
+                it->second();
+            } else {
+                *kept++ = std::move(*it);
+            }
+        }
+        retired.erase(kept, retired.end());
+    }
+
+    public:
+        static EpochDomain& instance() {
+            static EpochDomain domain;
+            return domain;
+        }
+
+        ~EpochDomain() {
+            for (auto& entry : retired) {
+                entry.second();
+            }
+            for (Slot* s = slots.load(); s;) {
+                Slot* next = s->next;
+                delete s;
+                s = next;
+            }
+        }
+
+        class Guard {
+            Slot* slot;
+            public:
+                explicit Guard(Slot* s) : slot(s) {}
+                Guard(const Guard&) = delete;
+                Guard& operator=(const Guard&) = delete;
+                ~Guard() { slot->epoch.store(kIdle, memory_order_release); }
+        };
+
+        // The seq_cst store pairs with the writer's seq_cst exchange: a reader
+        // either shows up in the writer's slot scan or sees the new catalog.
+        Guard pin() {
+            Slot* slot = localSlot();
+            slot->epoch.store(globalEpoch.load(memory_order_relaxed));
+            return Guard(slot);
+        }
+
+        void retire(function<void()> deleter) {
+            lock_guard<mutex> lock(retireMutex);
+            retired.emplace_back(globalEpoch.fetch_add(1), std::move(deleter));
+            reclaimLocked();
+        }
+
+        // Waits until no reader can still see anything retired before the
+        // call, then frees it.
+        void synchronize() {
+            uint64_t target = globalEpoch.fetch_add(1) + 1;
+            for (Slot* s = slots.load(memory_order_acquire); s; s = s->next) {
+                while (s->epoch.load() < target) {
+                    this_thread::yield();
+                }
+            }
+            lock_guard<mutex> lock(retireMutex);
+            reclaimLocked();
+        }
+};
+
 // Registry based factory
+// The registered shapes are published as an immutable, versioned Catalog
+// that carries a PerfectHashTable of their names. Writers build a new
+// catalog under the writer mutex and swap the pointer (read-copy-update);
+// the old one is retired through the EpochDomain. registerShape() and
+// unregisterShape() publish at once. Many registrations, such as the static
+// ones, are staged with stageShape() and published together by commit() or
+// freeze(), so N of them cost one table build rather than N. create() and
+// createInto() only pin, load and probe, so plugins can come and go while
+// workers create shapes without ever taking a lock. freeze() closes
+// registration for good, after which the catalog can no longer be retired
+// and lookups skip the pin as well.
 class ShapeFactory {
+    struct Catalog {
+        uint64_t version;
+        PerfectHashTable table;
+    };
+
     public:
-        using CreatorFunc = std::function<std::unique_ptr<Shape>()>;
         static ShapeFactory& instance() {
             static ShapeFactory factory;
             return factory;
         }
 
-        void registerShape(const std::string &name, CreatorFunc creator) {
-            creators[name] = creator;
+        ShapeFactory() : current(new Catalog{0, {}}) {}
+        ShapeFactory(const ShapeFactory&) = delete;
+        ShapeFactory& operator=(const ShapeFactory&) = delete;
+
+        // No lookup may be running on a factory being destroyed.
+        ~ShapeFactory() { delete current.load(); }
+
+        // Adds or replaces `name`, publishes it along with anything staged,
+        // and returns the catalog version that includes it.
+        uint64_t registerShape(const std::string &name, ShapeType type) {
+            lock_guard<mutex> lock(writerMutex);
+            stageLocked(name, type);
+            return publish();
+        }
+
+        // Adds or replaces `name` without publishing it: lookups only see it
+        // after the next commit(), registerShape(), unregisterShape() or
+        // freeze().
+        void stageShape(const std::string &name, ShapeType type) {
+            lock_guard<mutex> lock(writerMutex);
+            stageLocked(name, type);
         }
 
-        std::unique_ptr<Shape> create(const std::string &name) {
-            auto it = creators.find(name);
-            if(it != creators.end()) {
-                return (it->second)();
+        // Publishes everything staged as one catalog and returns the current
+        // version.
+        uint64_t commit() {
+            lock_guard<mutex> lock(writerMutex);
+            if (staged) {
+                publish();
             }
-            return nullptr;
+            return current.load()->version;
         }
+
+        // Returns false if `name` was not registered. Before a plugin unloads
+        // the code behind a shape it must call synchronize() and must have
+        // destroyed every shape of that type.
+        bool unregisterShape(const std::string &name) {
+            lock_guard<mutex> lock(writerMutex);
+            if (frozen) {
+                throw logic_error("ShapeFactory is frozen; cannot unregister " + name);
+            }
+            if (entries.erase(name) == 0) {
+                return false;
+            }
+            publish();
+            return true;
+        }
+
+        // Returns once no create() can still be using a catalog replaced
+        // before the call, so no new shape of an unregistered type can
+        // appear. It knows nothing of shapes made earlier: their vtables and
+        // destructors live in the plugin's code, so the plugin must see every
+        // one of them destroyed before it unloads.
+        void synchronize() {
+            EpochDomain::instance().synchronize();
+        }
+
+        void freeze() {
+            lock_guard<mutex> lock(writerMutex);
+            if (staged) {
+                publish();
+            }
+            frozen.store(true, memory_order_release);
+        }
+
+        bool isFrozen() const { return frozen.load(memory_order_acquire); }
+
+        uint64_t version() const {
+            return withCatalog([](const Catalog& catalog) { return catalog.version; });
+        }
+
+        std::unique_ptr<Shape> create(string_view name) const {
+            return withCatalog([&](const Catalog& catalog) -> unique_ptr<Shape> {
+                const ShapeType* type = catalog.table.find(name);
+                return type ? type->create() : nullptr;
+            });
+        }
+
+        // Constructs the shape inside `arena` instead of on the heap. The
+        // arena owns it; nullptr for an unknown name.
+        Shape* createInto(string_view name, ShapeArena& arena) const {
+            return withCatalog([&](const Catalog& catalog) -> Shape* {
+                const ShapeType* type = catalog.table.find(name);
+                if (!type) {
+                    return nullptr;
+                }
+                return arena.adopt(type->constructAt(arena.allocate(type->size, type->align)));
+            });
+        }
+
     private:
-        std::unordered_map<std::string, CreatorFunc> creators;
+        mutable mutex writerMutex;
+        unordered_map<string, ShapeType> entries; // guarded by writerMutex
+        bool staged = false;                      // guarded by writerMutex
+        atomic<const Catalog*> current;
+        atomic<bool> frozen{false};
+
+        template<typename F>
+        auto withCatalog(F&& use) const -> decltype(use(declval<const Catalog&>())) {
+            if (frozen.load(memory_order_acquire)) {
+                return use(*current.load(memory_order_acquire));
+            }
+            EpochDomain::Guard guard = EpochDomain::instance().pin();
+            return use(*current.load());
+        }
+
+        // Caller holds writerMutex.
+        void stageLocked(const std::string &name, ShapeType type) {
+            if (frozen) {
+                throw logic_error("ShapeFactory is frozen; cannot register " + name);
+            }
+            entries[name] = type;
+            staged = true;
+        }
+
+        // Caller holds writerMutex.
+        uint64_t publish() {
+            uint64_t version = current.load()->version + 1;
+            const Catalog* old = current.exchange(new Catalog{version, PerfectHashTable(entries)});
+            staged = false;
+            EpochDomain::instance().retire([old] { delete old; });
+            return version;
+        }
 };
 
-// Auto-register helper 
+// Auto-register helper. Static registrations are staged, and main()
+// publishes them all at once with commit() or freeze() before any lookup.
 template<typename T>
 class ShapeRegistrar {
     public:
         ShapeRegistrar(const std::string& name) {
-            ShapeFactory.instance().registerShape(name, [](){
-                return std::make_unique<T>();
-            });
+            ShapeFactory::instance().stageShape(name, ShapeType::of<T>());
         }
 };
 
 // Register classes
-static Shape
\ No newline at end of file
+static ShapeRegistrar<Circle> circleRegistrar("circle");
+static ShapeRegistrar<Square> squareRegistrar("square");
+static ShapeRegistrar<Triangle> triangleRegistrar("triangle");
+
+// Compile-time registry over a list of shape types, each of which names
+// itself with a static constexpr `name`. Ids are positions in the list:
+// id("circle") is a constant expression, so create<id("circle")>() names the
+// concrete type directly with no lookup and no static registration. Ids only
+// known at run time dispatch through a constexpr table of function pointers.
+// (String literals cannot be template arguments before C++20, hence the id.)
+template<typename... Ts>
+class Registry {
+    static constexpr string_view names[] = {Ts::name...};
+
+    template<typename T>
+    static unique_ptr<Shape> make() { return make_unique<T>(); }
+
+    template<typename T>
+    static Shape* makeAt(void* storage) { return new (storage) T(); }
+
+    static constexpr unique_ptr<Shape> (*creators[])() = {&make<Ts>...};
+    static constexpr Shape* (*placers[])(void*) = {&makeAt<Ts>...};
+    static constexpr size_t sizes[] = {sizeof(Ts)...};
+    static constexpr size_t aligns[] = {alignof(Ts)...};
+
+    static constexpr bool namesAreUnique() {
+        for (size_t i = 0; i < sizeof...(Ts); ++i) {
+            for (size_t j = i + 1; j < sizeof...(Ts); ++j) {
+                if (names[i] == names[j]) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+    static_assert(namesAreUnique(), "two registered shapes share a name");
+
+    public:
+        static constexpr size_t size = sizeof...(Ts);
+        static constexpr size_t npos = size;
+
+        // Position of `name` in the list, or npos.
+        static constexpr size_t id(string_view name) {
+            for (size_t i = 0; i < size; ++i) {
+                if (names[i] == name) {
+                    return i;
+                }
+            }
+            return npos;
+        }
+
+        template<size_t Id>
+        using Type = tuple_element_t<Id, tuple<Ts...>>;
+
+        template<size_t Id>
+        static unique_ptr<Type<Id>> create() {
+            static_assert(Id < size, "no shape with that name is registered");
+            return make_unique<Type<Id>>();
+        }
+
+        template<size_t Id>
+        static Type<Id>* createInto(ShapeArena& arena) {
+            static_assert(Id < size, "no shape with that name is registered");
+            using T = Type<Id>;
+            T* shape = new (arena.allocate(sizeof(T), alignof(T))) T();
+            arena.adopt(shape);
+            return shape;
+        }
+
+        // Run-time ids: one bounds check and an indirect call.
+        static unique_ptr<Shape> create(size_t id) {
+            return id < size ? creators[id]() : nullptr;
+        }
+
+        static Shape* createInto(size_t id, ShapeArena& arena) {
+            if (id >= size) {
+                return nullptr;
+            }
+            return arena.adopt(placers[id](arena.allocate(sizes[id], aligns[id])));
+        }
+
+        // Fills a dynamic factory from the list, in place of ShapeRegistrars,
+        // as one published catalog.
+        static void registerInto(ShapeFactory& factory) {
+            (factory.stageShape(string(Ts::name), ShapeType::of<Ts>()), ...);
+            factory.commit();
+        }
+};
+
+using Shapes = Registry<Circle, Square, Triangle>;
+
+// A shape that arrives with a plugin at run time.
+class Hexagon : public Shape {
+    public:
+        void draw() override {
+            cout << "Drawing hexagon" << endl;
+        }
+};
+
+// Worker threads create shapes by name while a plugin thread keeps loading
+// and unloading "hexagon".
+void runPluginBenchmark(unsigned workers, size_t createsPerWorker) {
+    ShapeFactory factory;
+    Shapes::registerInto(factory);
+    atomic<bool> done{false};
+    thread plugin([&] {
+        while (!done.load(memory_order_relaxed)) {
+            factory.registerShape("hexagon", ShapeType::of<Hexagon>());
+            factory.unregisterShape("hexagon");
+            factory.synchronize();
+        }
+    });
+
+    const char* names[] = {"circle", "square", "triangle", "hexagon"};
+    atomic<size_t> created{0};
+    auto start = chrono::steady_clock::now();
+    vector<thread> threads;
+    for (unsigned w = 0; w < workers; ++w) {
+        threads.emplace_back([&] {
+            ShapeArena arena;
+            size_t local = 0;
+            for (size_t i = 0; i < createsPerWorker; ++i) {
+                local += factory.createInto(names[i % 4], arena) != nullptr;
+                if (arena.size() == 100000) {
+                    arena.reset();
+                }
+            }
+            created += local;
+        });
+    }
+    for (thread& t : threads) {
+        t.join();
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    done = true;
+    plugin.join();
+    cout << workers << " workers: " << double(workers * createsPerWorker) / seconds / 1e6
+        << "M creates/s while " << factory.version() << " catalog versions were published ("
+        << created << " created)" << endl;
+}
+
+// Creates shapes by name the way a level loader would, from a list read out
+// of a data file, with the map-and-heap path, the perfect-hash arena path,
+// and the Registry jump table over ids resolved once when the file is read.
+void runBenchmark(size_t count) {
+    const char* names[] = {"circle", "square", "triangle"};
+    vector<string> data;
+    data.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        data.push_back(names[(i * 7) % 3]);
+    }
+
+    // The registry as it used to be.
+    unordered_map<string, function<unique_ptr<Shape>()>> map = {
+        {"circle", [] { return unique_ptr<Shape>(make_unique<Circle>()); }},
+        {"square", [] { return unique_ptr<Shape>(make_unique<Square>()); }},
+        {"triangle", [] { return unique_ptr<Shape>(make_unique<Triangle>()); }},
+    };
+    ShapeFactory registry;
+    Shapes::registerInto(registry);
+
+    using Clock = chrono::steady_clock;
+    auto start = Clock::now();
+    {
+        vector<unique_ptr<Shape>> shapes;
+        shapes.reserve(count);
+        for (const string& name : data) {
+            shapes.push_back(map.at(name)());
+        }
+    }
+    double heapMs = chrono::duration<double, milli>(Clock::now() - start).count();
+
+    registry.freeze();
+    ShapeArena arena;
+    start = Clock::now();
+    for (const string& name : data) {
+        registry.createInto(name, arena);
+    }
+    arena.reset();
+    double arenaMs = chrono::duration<double, milli>(Clock::now() - start).count();
+
+    vector<size_t> ids;
+    ids.reserve(count);
+    for (const string& name : data) {
+        ids.push_back(Shapes::id(name));
+    }
+    start = Clock::now();
+    for (size_t id : ids) {
+        Shapes::createInto(id, arena);
+    }
+    arena.reset();
+    double tableMs = chrono::duration<double, milli>(Clock::now() - start).count();
+
+    cout << count << " shapes: map + std::function + make_unique " << heapMs << " ms, perfect hash + arena "
+        << arenaMs << " ms, id jump table + arena " << tableMs << " ms" << endl;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && string(argv[1]) == "bench") {
+        runBenchmark(10000000);
+        runPluginBenchmark(max(1u, thread::hardware_concurrency()), 2000000);
+        return 0;
+    }
+
+    ShapeFactory& factory = ShapeFactory::instance();
+    factory.freeze();
+
+    auto circle = factory.create("circle");
+    circle->draw();
+    cout << "Unknown shape: " << (factory.create("hexagon") ? "created" : "nullptr") << endl;
+
+    ShapeArena frame;
+    for (const char* name : {"square", "triangle", "circle", "square"}) {
+        factory.createInto(name, frame)->draw();
+    }
+    cout << frame.size() << " shapes in the frame arena" << endl;
+    frame.reset();
+
+    try {
+        factory.registerShape("hexagon", ShapeType::of<Circle>());
+    } catch (const logic_error& e) {
+        cout << e.what() << endl;
+    }
+
+    // Known at build time: the concrete type, no lookup.
+    static_assert(Shapes::id("square") == 1, "ids follow the type list");
+    unique_ptr<Square> square = Shapes::create<Shapes::id("square")>();
+    square->draw();
+    Shapes::createInto<Shapes::id("triangle")>(frame)->draw();
+
+    // Known at run time: resolve the id once, then dispatch through the table.
+    for (string name : {"circle", "hexagon"}) {
+        size_t id = Shapes::id(name);
+        cout << name << " -> id " << id << ": " << (Shapes::create(id) ? "created" : "nullptr") << endl;
+    }
+
+    // A factory that stays open to plugins, read by a worker meanwhile.
+    ShapeFactory plugins;
+    Shapes::registerInto(plugins);
+    atomic<bool> loaded{false};
+    thread worker([&] {
+        while (!loaded.load()) {
+            plugins.create("circle");
+        }
+        plugins.create("hexagon")->draw();
+    });
+    uint64_t version = plugins.registerShape("hexagon", ShapeType::of<Hexagon>());
+    cout << "Plugin loaded at catalog version " << version << endl;
+    loaded = true;
+    worker.join();
+    plugins.unregisterShape("hexagon");
+    // The worker's hexagon is gone and no lookup can make another, so the
+    // plugin's code could be unloaded here.
+    plugins.synchronize();
+    cout << "Plugin unloaded at version " << plugins.version() << ", hexagon: "
+        << (plugins.create("hexagon") ? "created" : "nullptr") << endl;
+    return 0;
+}
@@ -4,9 +4,22 @@
 // Use Case:
 // When you need to create a large number of objects, and many of them share common data.
 
+// How to compile - g++ -std=c++17 -pthread flyweight.cpp
+
 #include<iostream>
-#include<unordered_map>
+#include<string>
+#include<string_view>
+#include<vector>
 #include<memory>
+#include<atomic>
+#include<mutex>
+#include<thread>
+#include<cstdint>
+#include<stdexcept>
+#include<algorithm>
+#include<iterator>
+#include<chrono>
+#include<condition_variable>
 
 class CharacterStyle {
     std::string font;
@@ -16,23 +29,291 @@ class CharacterStyle {
     public:
         CharacterStyle(const std::string &f, int s, const std::string &c)
             : font(f), size(s), color(c) {}
+
+        bool matches(std::string_view f, int s, std::string_view c) const {
+            return size == s && font == f && color == c;
+        }
+
+        // Bytes this style occupies, counting string storage beyond the
+        // small-string buffer.
+        std::size_t footprint() const {
+            std::size_t bytes = sizeof(CharacterStyle);
+            for (const std::string *s : {&font, &color}) {
+                if (s->capacity() > std::string().capacity()) bytes += s->capacity() + 1;
+            }
+            return bytes;
+        }
+
+        const std::string& getFont() const { return font; }
+        int getSize() const { return size; }
+        const std::string& getColor() const { return color; }
+};
+
+// Small integer handle for an interned style.
+using StyleId = std::uint16_t;
+
+// Consecutive glyphs sharing a style, as documents store them.
+struct StyleRun {
+    std::uint32_t first; // index of the first glyph in the run
+    StyleId style;
+};
+
+// Point-in-time view of how much sharing the factory achieves.
+struct StyleFactoryStats {
+    std::size_t uniqueStyles = 0;  // interned intrinsic states
+    std::size_t liveStyles = 0;    // styles referenced by at least one run
+    std::uint64_t references = 0;  // style runs referring to a style
+    std::uint64_t glyphs = 0;      // glyphs in those runs
+    std::vector<std::pair<StyleId, std::uint64_t>> referencesPerStyle;
+    std::size_t sharedBytes = 0;   // the interned styles plus one StyleRun per run
+    std::size_t unsharedBytes = 0; // every glyph holding its own CharacterStyle
+    double loadFactor = 0;
+    double averageProbe = 0;       // extra slots probed to find a style
+    std::size_t maxProbe = 0;
+
+    std::ptrdiff_t bytesSaved() const {
+        return std::ptrdiff_t(unsharedBytes) - std::ptrdiff_t(sharedBytes);
+    }
 };
 
 // Flyweight factory
+// Styles are interned in an open-addressed table keyed by a hash of
+// (font, size, color). A published slot never changes, so looking up a
+// style that already exists is lock-free: only acquire loads, no key
+// string is built and nothing is allocated. Inserting a new style takes a
+// mutex, which is rare once a document's styles have been seen.
+//
+// Holders of ids (a document's style runs) Retain and Release them so that
+// Collect can reclaim unused styles. A run is retained once, however many
+// glyphs it grows to; glyph counts are reported separately, for Stats only.
 class CharacterStyleFactory {
     public:
-        std::shared_ptr<CharacterStyle> GetStyle(const std::string &font,
-        int size,
-        const std::string &color) {
-            std::string key = font + std::to_string(size) + color;
-            if(styles.find(key) == styles.end()) {
-                styles[key] = std::make_shared(CharacterStyle(font, size, color))
+        static const std::size_t maxStyles = std::size_t(1) << 16;
+
+        CharacterStyleFactory()
+            : slots(new std::atomic<std::uint64_t>[tableSize]()),
+              styles(new std::atomic<const CharacterStyle*>[maxStyles]()),
+              refs(new std::atomic<std::uint64_t>[maxStyles]()),
+              glyphCounts(new std::atomic<std::uint64_t>[maxStyles]()) {}
+
+        CharacterStyleFactory(const CharacterStyleFactory&) = delete;
+        CharacterStyleFactory& operator=(const CharacterStyleFactory&) = delete;
+
+        // The id is only guaranteed until the next Collect(), which may free
+        // and reuse it if nothing has retained it. Use AcquireStyle to hold on.
+        StyleId GetStyle(const std::string &font, int size, const std::string &color) {
+            std::uint64_t h = hash(font, size, color);
+            StyleId id;
+            if (find(h, font, size, color, id)) {
+                return id;
+            }
+            return insert(h, font, size, color);
+        }
+
+        // GetStyle plus Retain. Nothing here keeps Collect() out between the
+        // two: like every lookup, it relies on the caller never running
+        // Collect() while other threads resolve styles.
+        StyleId AcquireStyle(const std::string &font, int size, const std::string &color) {
+            StyleId id = GetStyle(font, size, color);
+            Retain(id);
+            return id;
+        }
+
+        const CharacterStyle& GetStyleById(StyleId id) const {
+            return *styles[id].load(std::memory_order_acquire);
+        }
+
+        void Retain(StyleId id) {
+            refs[id].fetch_add(1, std::memory_order_relaxed);
+        }
+
+        // Drops a holder, along with the glyphs it had counted.
+        void Release(StyleId id, std::uint64_t glyphs = 0) {
+            refs[id].fetch_sub(1, std::memory_order_relaxed);
+            if (glyphs) glyphCounts[id].fetch_sub(glyphs, std::memory_order_relaxed);
+        }
+
+        void CountGlyphs(StyleId id, std::uint64_t glyphs) {
+            glyphCounts[id].fetch_add(glyphs, std::memory_order_relaxed);
+        }
+
+        std::size_t size() const { return interned.load(std::memory_order_acquire); }
+
+        // Frees every style no run refers to and rebuilds the table, returning
+        // the number of styles reclaimed. Their ids are reused by later inserts.
+        // Stop-the-world: no other thread may be resolving styles meanwhile,
+        // so call it between frames or after closing documents.
+        std::size_t Collect() {
+            std::lock_guard<std::mutex> lock(insertMutex);
+            std::size_t reclaimed = 0;
+            for (std::size_t id = 0; id < highWater; ++id) {
+                if (owned[id] && refs[id].load(std::memory_order_relaxed) == 0) {
+                    styles[id].store(nullptr, std::memory_order_relaxed);
+                    owned[id].reset();
+                    freeIds.push_back(StyleId(id));
+                    ++reclaimed;
+                }
+            }
+            for (std::size_t i = 0; i < tableSize; ++i) {
+                slots[i].store(0, std::memory_order_relaxed);
+            }
+            for (std::size_t id = 0; id < highWater; ++id) {
+                if (const CharacterStyle *style = owned[id].get()) {
+                    std::uint64_t h = hash(style->getFont(), style->getSize(), style->getColor());
+                    StyleId unused;
+                    std::size_t pos = 0;
+                    find(h, style->getFont(), style->getSize(), style->getColor(), unused, &pos);
+                    slots[pos].store(((h >> 32) << 32) | (id + 1), std::memory_order_release);
+                }
+            }
+            interned.fetch_sub(reclaimed, std::memory_order_release);
+            return reclaimed;
+        }
+
+        StyleFactoryStats Stats() const {
+            std::lock_guard<std::mutex> lock(insertMutex);
+            StyleFactoryStats stats;
+            std::size_t probes = 0;
+            for (std::size_t id = 0; id < highWater; ++id) {
+                const CharacterStyle *style = owned[id].get();
+                if (!style) continue;
+                std::uint64_t count = refs[id].load(std::memory_order_relaxed);
+                std::uint64_t glyphs = glyphCounts[id].load(std::memory_order_relaxed);
+                std::size_t bytes = style->footprint();
+                ++stats.uniqueStyles;
+                stats.liveStyles += count > 0;
+                stats.references += count;
+                stats.glyphs += glyphs;
+                stats.referencesPerStyle.emplace_back(StyleId(id), count);
+                stats.sharedBytes += bytes + count * sizeof(StyleRun);
+                stats.unsharedBytes += glyphs * bytes;
+
+                std::uint64_t h = hash(style->getFont(), style->getSize(), style->getColor());
+                std::size_t home = h & (tableSize - 1);
+                for (std::size_t i = home;; i = (i + 1) & (tableSize - 1)) {
+                    if ((slots[i].load(std::memory_order_relaxed) & 0xffffffffu) == id + 1) {
+                        std::size_t distance = (i - home) & (tableSize - 1);
+                        probes += distance;
+                        stats.maxProbe = std::max(stats.maxProbe, distance);
+                        break;
+                    }
+                }
+            }
+            stats.loadFactor = double(stats.uniqueStyles) / double(tableSize);
+            stats.averageProbe = stats.uniqueStyles ? double(probes) / double(stats.uniqueStyles) : 0;
+            return stats;
+        }
+
+    private:
+        // Twice the number of ids, so the load factor never exceeds 1/2.
+        static const std::size_t tableSize = maxStyles * 2;
+
+        // Slot layout: upper 32 bits of the key hash, then id + 1 (0 = empty).
+        std::unique_ptr<std::atomic<std::uint64_t>[]> slots;
+        std::unique_ptr<std::atomic<const CharacterStyle*>[]> styles;
+        std::unique_ptr<std::atomic<std::uint64_t>[]> refs;        // holders per id
+        std::unique_ptr<std::atomic<std::uint64_t>[]> glyphCounts; // for Stats
+        std::vector<std::unique_ptr<CharacterStyle>> owned; // by id
+        std::vector<StyleId> freeIds;
+        std::size_t highWater = 0; // ids handed out so far, including freed ones
+        std::atomic<std::size_t> interned{0};
+        mutable std::mutex insertMutex;
+
+        static std::uint64_t hash(std::string_view font, int size, std::string_view color) {
+            std::uint64_t h = std::hash<std::string_view>()(font);
+            h ^= std::uint64_t(size) + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+            h ^= std::hash<std::string_view>()(color) + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+            return h * 0xff51afd7ed558ccdull;
+        }
+
+        // Probes from the key's home slot; on a miss, pos is the empty slot.
+        bool find(std::uint64_t h, std::string_view font, int size, std::string_view color,
+                StyleId &id, std::size_t *pos = nullptr) const {
+            std::uint64_t tag = h >> 32;
+            for (std::size_t i = h & (tableSize - 1);; i = (i + 1) & (tableSize - 1)) {
+                std::uint64_t slot = slots[i].load(std::memory_order_acquire);
+                if (slot == 0) {
+                    if (pos) *pos = i;
+                    return false;
+                }
+                if ((slot >> 32) == tag) {
+                    StyleId candidate = StyleId((slot & 0xffffffffu) - 1);
+                    if (GetStyleById(candidate).matches(font, size, color)) {
+                        id = candidate;
+                        return true;
+                    }
+                }
+            }
+        }
+
+        StyleId insert(std::uint64_t h, const std::string &font, int size, const std::string &color) {
+            std::lock_guard<std::mutex> lock(insertMutex);
+            StyleId id;
+            std::size_t pos;
+            if (find(h, font, size, color, id, &pos)) {
+                return id; // another thread interned it first
+            }
+            if (!freeIds.empty()) {
+                id = freeIds.back();
+                freeIds.pop_back();
+            } else if (highWater < maxStyles) {
+                id = StyleId(highWater++);
+                owned.emplace_back();
+            } else {
+                throw std::length_error("CharacterStyleFactory: too many styles");
+            }
+            owned[id] = std::make_unique<CharacterStyle>(font, size, color);
+            styles[id].store(owned[id].get(), std::memory_order_release);
+            slots[pos].store(((h >> 32) << 32) | (std::uint64_t(id) + 1), std::memory_order_release);
+            interned.fetch_add(1, std::memory_order_release);
+            return id;
+        }
+};
+
+// Prints a factory's statistics every interval on a background thread, and
+// once more when stopped, so a short run still gets a report.
+class StatsReporter {
+    public:
+        StatsReporter(const CharacterStyleFactory &factory, std::chrono::milliseconds interval,
+                std::ostream &out = std::cout)
+            : factory(factory), interval(interval), out(out), worker([this] { run(); }) {}
+
+        ~StatsReporter() {
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                stopping = true;
             }
-            return styles[key];
+            cv.notify_one();
+            worker.join();
+        }
+
+        static void Dump(const StyleFactoryStats &stats, std::ostream &out) {
+            out << "[styles] unique: " << stats.uniqueStyles
+                << ", live: " << stats.liveStyles
+                << ", runs: " << stats.references
+                << ", glyphs: " << stats.glyphs
+                << ", bytes saved: " << stats.bytesSaved()
+                << ", load factor: " << stats.loadFactor
+                << ", avg/max probe: " << stats.averageProbe << "/" << stats.maxProbe
+                << std::endl;
         }
 
     private:
-        std::unordered_map<std::string, std::shared_ptr<CharacterStyle>> styles;
+        const CharacterStyleFactory &factory;
+        std::chrono::milliseconds interval;
+        std::ostream &out;
+        std::mutex mtx;
+        std::condition_variable cv;
+        bool stopping = false;
+        std::thread worker;
+
+        void run() {
+            std::unique_lock<std::mutex> lock(mtx);
+            while (!cv.wait_for(lock, interval, [this] { return stopping; })) {
+                Dump(factory.Stats(), out);
+            }
+            Dump(factory.Stats(), out);
+        }
 };
 
 // The flyweight: stores the shared state
@@ -40,33 +321,211 @@ class Character {
     char symbol;
     int x;
     int y;
-    std::shared_ptr<CharacterStyle> style;
+    StyleId style;
 
     public:
-        Character(char sym, int x, int y, std::shared_ptr<CharacterStyle> style)
+        Character(char sym, int x, int y, StyleId style)
             : symbol(sym), x(x), y(y), style(style) {}
 
-        void display(int x, int y) {
+        void display(const CharacterStyleFactory &factory) const {
+            const CharacterStyle &s = factory.GetStyleById(style);
             std::cout << "Char: " << symbol
-            << " At: (" << x << ", " << y;
+            << " At: (" << x << ", " << y << ")"
+            << " Style: " << s.getFont() << " " << s.getSize() << " " << s.getColor()
+            << std::endl;
         }
-}
+};
 
 // Client
+// Glyphs are stored as structure-of-arrays: one column each for symbols
+// and positions, and the style column run-length encoded, since consecutive
+// glyphs almost always share a style. That is 9 bytes per glyph plus one
+// StyleRun per style change, and range operations walk the columns
+// linearly, resolving each run's style once.
+//
+// Each run holds one reference to its style, taken when the run starts, so
+// typing into the current run touches no shared counter. Glyphs typed one
+// at a time are reported to the factory's statistics when their run ends.
 class Document {
     public:
+        explicit Document(CharacterStyleFactory &factory) : factory(factory) {}
+
+        Document(const Document&) = delete;
+        Document& operator=(const Document&) = delete;
+
+        // Closing a document drops its runs' style references.
+        ~Document() {
+            for (std::size_t i = 0; i < runs.size(); ++i) {
+                std::size_t end = i + 1 < runs.size() ? runs[i + 1].first : symbols.size();
+                std::size_t counted = end - runs[i].first - (i + 1 == runs.size() ? uncounted : 0);
+                factory.Release(runs[i].style, counted);
+            }
+        }
+
+        // Continuing the current run costs a style comparison; only a style
+        // change goes to the factory.
         void AddCharacter(char symbol,
         int x, int y,
         const std::string& font,
         int size,
         const std::string &colour) {
-            auto style = 
+            if (runs.empty() || !factory.GetStyleById(runs.back().style).matches(font, size, colour)) {
+                startRun(factory.AcquireStyle(font, size, colour));
+            }
+            ++uncounted;
+            symbols.push_back(symbol);
+            xs.push_back(x);
+            ys.push_back(y);
+        }
+
+        // Appends a run of glyphs laid out left to right from (x, y). The id
+        // must come from the factory since its last Collect().
+        void AddCharacters(std::string_view text, int x, int y, StyleId style) {
+            if (text.empty()) return;
+            if (runs.empty() || runs.back().style != style) {
+                factory.Retain(style);
+                startRun(style);
+            }
+            factory.CountGlyphs(style, text.size());
+            symbols.insert(symbols.end(), text.begin(), text.end());
+            for (std::size_t i = 0; i < text.size(); ++i) {
+                xs.push_back(x + int(i));
+                ys.push_back(y);
+            }
+        }
+
+        void AddCharacters(std::string_view text, int x, int y,
+        const std::string& font,
+        int size,
+        const std::string &colour) {
+            StyleId style = factory.AcquireStyle(font, size, colour);
+            AddCharacters(text, x, y, style);
+            factory.Release(style);
+        }
+
+        void Reserve(std::size_t glyphs) {
+            symbols.reserve(glyphs);
+            xs.reserve(glyphs);
+            ys.reserve(glyphs);
+        }
+
+        std::size_t size() const { return symbols.size(); }
+        const std::vector<StyleRun>& Runs() const { return runs; }
+
+        StyleId StyleAt(std::size_t index) const {
+            auto it = std::upper_bound(runs.begin(), runs.end(), index,
+                [](std::size_t i, const StyleRun &run) { return i < run.first; });
+            return std::prev(it)->style;
+        }
+
+        // Calls f(symbol, x, y, style) for glyphs [first, last).
+        template <typename F>
+        void ForEach(std::size_t first, std::size_t last, F f) const {
+            forEachRun(first, last, [&](std::size_t begin, std::size_t end, StyleId id) {
+                const CharacterStyle &style = factory.GetStyleById(id);
+                for (std::size_t i = begin; i < end; ++i) {
+                    f(symbols[i], xs[i], ys[i], style);
+                }
+            });
+        }
+
+        void Render(std::size_t first = 0, std::size_t last = SIZE_MAX) const {
+            forEachRun(first, last, [this](std::size_t begin, std::size_t end, StyleId id) {
+                for (std::size_t i = begin; i < end; ++i) {
+                    Character(symbols[i], xs[i], ys[i], id).display(factory);
+                }
+            });
         }
 
     private:
-        std::
+        CharacterStyleFactory &factory;
+        std::vector<char> symbols;
+        std::vector<std::int32_t> xs;
+        std::vector<std::int32_t> ys;
+        std::vector<StyleRun> runs;
+        // Glyphs added one at a time to the last run, not yet counted in the
+        // factory's stats. Bulk appends are counted as they happen.
+        std::size_t uncounted = 0;
+
+        // Calls f(begin, end, style) for each part of a style run in [first, last).
+        template <typename F>
+        void forEachRun(std::size_t first, std::size_t last, F f) const {
+            last = std::min(last, symbols.size());
+            if (first >= last) return;
+            auto run = std::prev(std::upper_bound(runs.begin(), runs.end(), first,
+                [](std::size_t i, const StyleRun &r) { return i < r.first; }));
+            for (; first < last; ++run) {
+                std::size_t end = std::next(run) == runs.end() ? last
+                    : std::min<std::size_t>(last, std::next(run)->first);
+                f(first, end, run->style);
+                first = end;
+            }
+        }
+
+        // Takes over a retained style for a new run, first counting the
+        // glyphs of the run it ends.
+        void startRun(StyleId style) {
+            if (!runs.empty()) factory.CountGlyphs(runs.back().style, uncounted);
+            uncounted = 0;
+            runs.push_back({std::uint32_t(symbols.size()), style});
+        }
 };
 
 int main() {
+    CharacterStyleFactory factory;
+    Document doc(factory);
+
+    doc.AddCharacter('H', 0, 0, "Arial", 12, "Black");
+    doc.AddCharacter('i', 1, 0, "Arial", 12, "Black");
+    doc.AddCharacter('!', 2, 0, "Arial", 14, "Red");
+    doc.AddCharacters("ok", 0, 1, "Arial", 12, "Black");
+    doc.Render();
+
+    std::size_t black = 0;
+    doc.ForEach(0, doc.size(), [&black](char, int, int, const CharacterStyle &style) {
+        if (style.getColor() == "Black") ++black;
+    });
+    std::cout << "Glyphs: " << doc.size() << ", style runs: " << doc.Runs().size()
+        << ", black glyphs: " << black << std::endl;
+
+    // Many threads resolving the same styles get the same ids. The reporter
+    // watches the factory meanwhile and reports when it stops.
+    std::atomic<bool> consistent{true};
+    {
+        StatsReporter reporter(factory, std::chrono::seconds(1));
+        std::vector<std::thread> renderers;
+        for (int t = 0; t < 4; ++t) {
+            renderers.emplace_back([&factory, &consistent] {
+                for (int i = 0; i < 1000; ++i) {
+                    StyleId id = factory.GetStyle("Times", 10 + i % 8, "Blue");
+                    if (!factory.GetStyleById(id).matches("Times", 10 + i % 8, "Blue")) {
+                        consistent = false;
+                    }
+                }
+            });
+        }
+        for (auto &t : renderers) {
+            t.join();
+        }
+    }
+
+    std::cout << "Unique styles: " << factory.size()
+        << (consistent ? "" : " (inconsistent lookups!)") << std::endl;
+
+    // Until Collect(), the Times styles cost their bytes without any glyph
+    // using them, and a handful of glyphs per style saves little: in the
+    // report above sharing still loses. A page of text in two styles is
+    // where it pays.
+    {
+        Document draft(factory);
+        for (int line = 0; line < 40; ++line) {
+            draft.AddCharacters("Draft", 0, line * 2, "Courier", 9, "Grey");
+            draft.AddCharacters(std::string(75, 'x'), 0, line * 2 + 1, "Courier New", 10, "Dark Grey");
+        }
+        StatsReporter::Dump(factory.Stats(), std::cout);
+    }
+    // The Times styles were only looked up and the draft is closed.
+    std::cout << "Reclaimed styles: " << factory.Collect() << std::endl;
+    StatsReporter::Dump(factory.Stats(), std::cout);
     return 0;
-}
\ No newline at end of file
+}
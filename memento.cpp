@@ -19,63 +19,1229 @@
 // Caretaker: manages mementos (keeps history, allows undo/redo).
 
 // How to compile and run - 
-// digambarmandhare@Digambars-Air designpatterns % g++ -std=c++17 memento.cpp
+// digambarmandhare@Digambars-Air designpatterns % g++ -std=c++17 -pthread memento.cpp
 // digambarmandhare@Digambars-Air designpatterns % ./a.out 
 // Initial state: Hello World!
 // After first undo: Hello World!
 // After second undo: Hello
+// Delta state: Hello, there!
+// After delta undo: Hello, World!
+// After checkpoint undo: Hello World!
+// Bounded history: 6 mementos, 202 bytes in memory, 97 bytes spilled
+// Oldest memento: Line 1 of a long and repetitive document.
+// Async snapshot: 42 bytes, restored: Line 1 of a long and repetitive document.
+// digambarmandhare@Digambars-Air designpatterns % ./a.out bench
+// (edit and snapshot latency on a 100 MB buffer, std::string vs PieceTree,
+//  then edit latency percentiles with no, sync and async snapshots)
 
 #include<iostream>
+#include<fstream>
 #include<string>
 #include<memory>
 #include<vector>
+#include<random>
+#include<chrono>
+#include<deque>
+#include<thread>
+#include<mutex>
+#include<condition_variable>
+#include<future>
+#include<algorithm>
+#include<filesystem>
+#include<limits>
+#include<cstdint>
+#include<atomic>
+#include<cstring>
+#include<stdexcept>
+#include<system_error>
+#include<fcntl.h>
+#include<sys/mman.h>
+#include<unistd.h>
 
+// Persistent piece tree: an implicit treap whose nodes are pieces of
+// append-only text chunks. Nodes are never modified, so an edit copies only
+// the O(log n) nodes on its path and every older copy of the tree stays
+// valid. Copying a PieceTree is therefore an O(1) snapshot.
+//
+// Inserted text goes into an add buffer, as in a classic piece table:
+// 64 KB chunks that pieces index into. Typing at the end of the previous
+// insert grows that piece instead of adding a node, so a keystroke costs
+// its own byte rather than an allocation.
+class PieceTree {
+    private:
+        // Bytes are claimed with an atomic bump, so copies of a tree that
+        // keep editing (restored snapshots, replays on other threads) never
+        // write over each other, and claimed bytes never change once written.
+        struct Chunk {
+            std::unique_ptr<char[]> data;
+            std::size_t capacity;
+            std::atomic<std::size_t> used{0};
+            explicit Chunk(std::size_t cap) : data(new char[cap]), capacity(cap) {}
+        };
+        static constexpr std::size_t chunkSize = std::size_t(64) << 10;
+
+        struct Node;
+        using NodePtr = std::shared_ptr<const Node>;
+
+        struct Node {
+            std::shared_ptr<const Chunk> buf;
+            std::size_t off;
+            std::size_t len;
+            std::size_t total; // bytes in this subtree
+            std::uint32_t prio;
+            NodePtr left;
+            NodePtr right;
+        };
+
+        NodePtr root;
+        std::shared_ptr<Chunk> add;
+        // The piece made by the last insert and where it ends in the text,
+        // while no other edit has moved it.
+        std::shared_ptr<const Chunk> lastBuf;
+        std::size_t lastOff = 0;
+        std::size_t lastLen = 0;
+        std::size_t lastEnd = std::numeric_limits<std::size_t>::max();
+
+        static std::size_t sizeOf(const NodePtr& n) { return n ? n->total : 0; }
+
+        static NodePtr make(const Node& piece, NodePtr l, NodePtr r) {
+            return std::make_shared<const Node>(Node{piece.buf, piece.off, piece.len,
+                sizeOf(l) + piece.len + sizeOf(r), piece.prio, std::move(l), std::move(r)});
+        }
+
+        static std::uint32_t nextPriority() {
+            static thread_local std::mt19937 rng(std::random_device{}());
+            return rng();
+        }
+
+        // Copies s into the add buffer and returns where it landed. Large
+        // inserts get a chunk of their own.
+        std::pair<std::shared_ptr<const Chunk>, std::size_t> store(const std::string& s) {
+            std::shared_ptr<Chunk> chunk;
+            std::size_t off = 0;
+            if (s.size() > chunkSize / 4) {
+                chunk = std::make_shared<Chunk>(s.size());
+                chunk->used = s.size();
+            } else {
+                if (add) {
+                    off = add->used.fetch_add(s.size());
+                }
+                if (!add || off + s.size() > add->capacity) {
+                    add = std::make_shared<Chunk>(chunkSize);
+                    off = add->used.fetch_add(s.size());
+                }
+                chunk = add;
+            }
+            std::memcpy(chunk->data.get() + off, s.data(), s.size());
+            return {std::move(chunk), off};
+        }
+
+        // Splits n into [0, pos) and [pos, end), cutting a piece in two if needed.
+        static std::pair<NodePtr, NodePtr> split(const NodePtr& n, std::size_t pos) {
+            if (!n) return {nullptr, nullptr};
+            std::size_t leftSize = sizeOf(n->left);
+            if (pos <= leftSize) {
+                auto parts = split(n->left, pos);
+                return {parts.first, make(*n, parts.second, n->right)};
+            }
+            if (pos >= leftSize + n->len) {
+                auto parts = split(n->right, pos - leftSize - n->len);
+                return {make(*n, n->left, parts.first), parts.second};
+            }
+            std::size_t cut = pos - leftSize;
+            Node head = *n;
+            head.len = cut;
+            Node tail = *n;
+            tail.off += cut;
+            tail.len -= cut;
+            return {make(head, n->left, nullptr), make(tail, nullptr, n->right)};
+        }
+
+        static NodePtr merge(const NodePtr& a, const NodePtr& b) {
+            if (!a) return b;
+            if (!b) return a;
+            if (a->prio > b->prio) {
+                return make(*a, a->left, merge(a->right, b));
+            }
+            return make(*b, merge(a, b->left), b->right);
+        }
+
+        static void appendTo(const NodePtr& n, std::string& out) {
+            // In-order walk with an explicit stack; the tree is shallow but
+            // this keeps flattening cheap for large documents.
+            std::vector<const Node*> stack;
+            const Node* cur = n.get();
+            while (cur || !stack.empty()) {
+                while (cur) {
+                    stack.push_back(cur);
+                    cur = cur->left.get();
+                }
+                cur = stack.back();
+                stack.pop_back();
+                out.append(cur->buf->data.get() + cur->off, cur->len);
+                cur = cur->right.get();
+            }
+        }
+
+    public:
+        PieceTree() = default;
+        explicit PieceTree(const std::string& s) { insert(0, s); }
+
+        std::size_t size() const { return sizeOf(root); }
+
+        void insert(std::size_t pos, const std::string& s) {
+            if (s.empty()) return;
+            if (pos > size()) throw std::out_of_range("PieceTree::insert");
+            auto [buf, off] = store(s);
+            if (pos == lastEnd && buf == lastBuf && off == lastOff + lastLen) {
+                // Typing on: swap the last piece for a longer one.
+                auto head = split(root, pos - lastLen);
+                auto tail = split(head.second, lastLen);
+                Node grown = *tail.first;
+                grown.len += s.size();
+                lastLen = grown.len;
+                root = merge(merge(head.first, make(grown, nullptr, nullptr)), tail.second);
+            } else {
+                Node piece{buf, off, s.size(), 0, nextPriority(), nullptr, nullptr};
+                auto parts = split(root, pos);
+                root = merge(merge(parts.first, make(piece, nullptr, nullptr)), parts.second);
+                lastBuf = std::move(buf);
+                lastOff = off;
+                lastLen = s.size();
+            }
+            lastEnd = pos + s.size();
+        }
+
+        void erase(std::size_t pos, std::size_t len) {
+            if (pos > size()) throw std::out_of_range("PieceTree::erase");
+            auto head = split(root, pos);
+            auto tail = split(head.second, len);
+            root = merge(head.first, tail.second);
+            lastEnd = std::numeric_limits<std::size_t>::max();
+        }
+
+        std::string substr(std::size_t pos, std::size_t len) const {
+            if (pos > size()) throw std::out_of_range("PieceTree::substr");
+            auto head = split(root, pos);
+            auto tail = split(head.second, len);
+            std::string out;
+            out.reserve(sizeOf(tail.first));
+            appendTo(tail.first, out);
+            return out;
+        }
+
+        std::string toString() const {
+            std::string out;
+            out.reserve(size());
+            appendTo(root, out);
+            return out;
+        }
+};
+
+// A single edit, recorded against the previously saved state.
+struct Edit {
+    std::size_t pos;
+    std::string inserted;
+    std::string removed;
+};
+
+// Edits as cold deltas store them: varint position and lengths per edit,
+// followed by the inserted and removed bytes.
+void putVarint(std::string& out, std::uint64_t v) {
+    for (; v >= 0x80; v >>= 7) out.push_back(char(v | 0x80));
+    out.push_back(char(v));
+}
+
+std::size_t varintSize(std::uint64_t v) {
+    std::size_t n = 1;
+    for (; v >= 0x80; v >>= 7) ++n;
+    return n;
+}
+
+std::size_t encodedSize(const std::vector<Edit>& edits) {
+    std::size_t bytes = 0;
+    for (const Edit& e : edits) {
+        bytes += varintSize(e.pos) + varintSize(e.inserted.size()) + varintSize(e.removed.size())
+            + e.inserted.size() + e.removed.size();
+    }
+    return bytes;
+}
+
+std::string encodeEdits(const std::vector<Edit>& edits) {
+    std::string out;
+    out.reserve(encodedSize(edits));
+    for (const Edit& e : edits) {
+        putVarint(out, e.pos);
+        putVarint(out, e.inserted.size());
+        putVarint(out, e.removed.size());
+        out += e.inserted;
+        out += e.removed;
+    }
+    return out;
+}
+
+std::vector<Edit> decodeEdits(const std::string& in) {
+    std::size_t at = 0;
+    auto varint = [&] {
+        std::uint64_t v = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (at == in.size()) throw std::runtime_error("truncated edit");
+            unsigned char b = static_cast<unsigned char>(in[at++]);
+            v |= std::uint64_t(b & 0x7f) << shift;
+            if (!(b & 0x80)) return v;
+        }
+        throw std::runtime_error("corrupt edit");
+    };
+    auto bytes = [&](std::uint64_t n) {
+        if (n > in.size() - at) throw std::runtime_error("truncated edit");
+        std::string s = in.substr(at, std::size_t(n));
+        at += std::size_t(n);
+        return s;
+    };
+    std::vector<Edit> edits;
+    while (at < in.size()) {
+        Edit e;
+        e.pos = std::size_t(varint());
+        std::uint64_t ins = varint();
+        std::uint64_t rem = varint();
+        e.inserted = bytes(ins);
+        e.removed = bytes(rem);
+        edits.push_back(std::move(e));
+    }
+    return edits;
+}
+
+// Replays edits the way they were made: each one removes, then inserts.
+void replay(PieceTree& text, const std::vector<Edit>& edits) {
+    for (const Edit& e : edits) {
+        text.erase(e.pos, e.removed.size());
+        text.insert(e.pos, e.inserted);
+    }
+}
+
+// A memento is either a checkpoint of the text, or a delta: the edits made
+// since the previous memento, which it shares instead of copying.
+// Checkpoints are piece tree snapshots, so they share structure with the
+// live document; deltas cost memory proportional to the edit.
+// Every memento also remembers which memento it followed and the edits
+// since then, so a caretaker can store either kind as a delta when cold.
 class Memento {
     private:
-        std::string state;
+        PieceTree state;
+        std::shared_ptr<const Memento> base;
+        std::vector<Edit> edits;
+        std::size_t depth = 0; // deltas since the last checkpoint
+        std::uint64_t id = nextId();
+        std::uint64_t prevId = 0; // 0: not linked to an earlier memento
+
+        static std::uint64_t nextId() {
+            static std::atomic<std::uint64_t> counter{0};
+            return ++counter;
+        }
     public:
         explicit Memento(const std::string& s) : state(s) {}
-        std::string getState() const { return state; }
+        explicit Memento(PieceTree snapshot) : state(std::move(snapshot)) {}
+        Memento(PieceTree snapshot, std::uint64_t prev, std::vector<Edit> sincePrev)
+            : state(std::move(snapshot)), edits(std::move(sincePrev)), prevId(prev) {}
+        Memento(std::shared_ptr<const Memento> prev, std::vector<Edit> e)
+            : base(std::move(prev)), edits(std::move(e)), depth(base->depth + 1),
+              prevId(base->id) {}
+
+        bool isCheckpoint() const { return !base; }
+        std::size_t chainDepth() const { return depth; }
+        std::uint64_t identity() const { return id; }
+        std::uint64_t previous() const { return prevId; }
+        const std::vector<Edit>& changes() const { return edits; }
+
+        // Walks back to the nearest checkpoint and replays the deltas forward.
+        PieceTree getText() const {
+            std::vector<const Memento*> chain;
+            const Memento* m = this;
+            for (; m->base; m = m->base.get()) {
+                chain.push_back(m);
+            }
+            PieceTree text = m->state;
+            for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+                replay(text, (*it)->edits);
+            }
+            return text;
+        }
+
+        std::string getState() const { return getText().toString(); }
+
+        // Bytes this memento keeps alive by itself. A checkpoint shares every
+        // piece with the previous memento except the text typed since, so
+        // only a checkpoint with no predecessor is charged its whole size.
+        std::size_t footprint() const {
+            if (!base && !prevId) return state.size();
+            return encodedSize(edits);
+        }
 };
 
 class TextEditor {
     private:
-        std::string text;
+        PieceTree text;
+        // 0 makes every save a checkpoint (an O(1) piece tree snapshot).
+        // Otherwise every N-th save is a checkpoint and the rest are deltas.
+        std::size_t checkpointEvery;
+        std::vector<Edit> pending;
+        std::shared_ptr<const Memento> last;
+
+        void record(Edit e) {
+            pending.push_back(std::move(e));
+        }
     public:
+        explicit TextEditor(std::size_t checkpointEvery = 0)
+            : checkpointEvery(checkpointEvery) {}
+
         void type(const std::string& words) {
-            text += words;
+            insert(text.size(), words);
         }
 
-        std::string getText() const {
+        void insert(std::size_t pos, const std::string& words) {
+            text.insert(pos, words);
+            record({pos, words, ""});
+        }
+
+        void erase(std::size_t pos, std::size_t len) {
+            std::string removed = text.substr(pos, len);
+            text.erase(pos, len);
+            record({pos, "", std::move(removed)});
+        }
+
+        std::size_t size() const {
+            return text.size();
+        }
+
+        // O(1) copy-on-write view of the live document, safe to hand to
+        // another thread.
+        PieceTree snapshot() const {
             return text;
         }
 
-        std::shared_ptr<Memento> save() const {
-            return std::make_shared<Memento>(text);
+        std::string getText() const {
+            return text.toString();
+        }
+
+        std::shared_ptr<Memento> save() {
+            std::shared_ptr<Memento> m;
+            if (checkpointEvery && last && last->chainDepth() + 1 < checkpointEvery) {
+                m = std::make_shared<Memento>(last, std::move(pending));
+            } else {
+                m = std::make_shared<Memento>(text, last ? last->identity() : 0, std::move(pending));
+            }
+            pending.clear();
+            last = m;
+            return m;
         }
 
         void restore(const std::shared_ptr<Memento>& memento) {
-            text = memento->getState();
+            text = memento->getText();
+            pending.clear();
+            last = memento;
+        }
+};
+
+// Codec used for cold mementos. Any fast byte compressor can be plugged in.
+class Codec {
+    public:
+        virtual std::string compress(const std::string& raw) const = 0;
+        virtual std::string decompress(const char* data, std::size_t size) const = 0;
+        virtual ~Codec() = default;
+};
+
+// LZ4-style block codec: a token byte holding literal and match lengths,
+// the literals, then a 16-bit back-reference offset. Matches are found
+// through a single-probe hash of the next four bytes, which keeps it fast
+// rather than small.
+class LzCodec : public Codec {
+    private:
+        static const int hashBits = 14;
+        static const std::size_t minMatch = 4;
+
+        static std::uint32_t read32(const char* p) {
+            std::uint32_t v;
+            std::memcpy(&v, p, sizeof v);
+            return v;
+        }
+
+        static void putLength(std::string& out, std::size_t extra) {
+            for (; extra >= 255; extra -= 255) out.push_back(char(255));
+            out.push_back(char(extra));
+        }
+
+        static std::size_t getLength(const unsigned char*& in, const unsigned char* end,
+                std::size_t base) {
+            if (base != 15) return base;
+            unsigned char b;
+            do {
+                if (in == end) throw std::runtime_error("LzCodec: truncated length");
+                b = *in++;
+                base += b;
+            } while (b == 255);
+            return base;
+        }
+
+        static void putSequence(std::string& out, const char* lit, std::size_t litLen,
+                std::size_t offset, std::size_t matchLen) {
+            std::size_t m = matchLen ? matchLen - minMatch : 0;
+            out.push_back(char((std::min<std::size_t>(litLen, 15) << 4) |
+                std::min<std::size_t>(m, 15)));
+            if (litLen >= 15) putLength(out, litLen - 15);
+            out.append(lit, litLen);
+            if (!matchLen) return;
+            out.push_back(char(offset & 0xff));
+            out.push_back(char(offset >> 8));
+            if (m >= 15) putLength(out, m - 15);
+        }
+
+    public:
+        std::string compress(const std::string& raw) const override {
+            std::string out;
+            std::uint64_t size = raw.size();
+            out.append(reinterpret_cast<const char*>(&size), sizeof size);
+
+            std::vector<std::uint32_t> table(std::size_t(1) << hashBits, 0);
+            const char* in = raw.data();
+            std::size_t n = raw.size(), anchor = 0, i = 0;
+            while (i + minMatch <= n) {
+                std::uint32_t seq = read32(in + i);
+                std::uint32_t h = (seq * 2654435761u) >> (32 - hashBits);
+                std::size_t cand = table[h];
+                table[h] = std::uint32_t(i + 1);
+                if (cand-- && i - cand <= 0xffff && read32(in + cand) == seq) {
+                    std::size_t len = minMatch;
+                    while (i + len < n && in[cand + len] == in[i + len]) ++len;
+                    putSequence(out, in + anchor, i - anchor, i - cand, len);
+                    i += len;
+                    anchor = i;
+                } else {
+                    ++i;
+                }
+            }
+            putSequence(out, in + anchor, n - anchor, 0, 0);
+            return out;
+        }
+
+        // Throws std::runtime_error on truncated or corrupt input instead of
+        // reading or copying out of bounds.
+        std::string decompress(const char* data, std::size_t size) const override {
+            std::uint64_t rawSize;
+            if (size < sizeof rawSize) throw std::runtime_error("LzCodec: missing header");
+            std::memcpy(&rawSize, data, sizeof rawSize);
+            std::string out;
+            // Each input byte expands to at most 255 output bytes, so a
+            // corrupt header cannot make us reserve more than that.
+            out.reserve(std::size_t(std::min<std::uint64_t>(rawSize, std::uint64_t(size) * 255)));
+            auto in = reinterpret_cast<const unsigned char*>(data) + sizeof rawSize;
+            auto end = reinterpret_cast<const unsigned char*>(data) + size;
+            while (in < end) {
+                unsigned char token = *in++;
+                std::size_t litLen = getLength(in, end, token >> 4);
+                if (litLen > std::size_t(end - in)) throw std::runtime_error("LzCodec: truncated literals");
+                out.append(reinterpret_cast<const char*>(in), litLen);
+                in += litLen;
+                if (in >= end) break;
+                if (end - in < 2) throw std::runtime_error("LzCodec: truncated offset");
+                std::size_t offset = in[0] | (std::size_t(in[1]) << 8);
+                in += 2;
+                std::size_t matchLen = getLength(in, end, token & 15) + minMatch;
+                if (offset == 0 || offset > out.size() || matchLen > rawSize - out.size()) {
+                    throw std::runtime_error("LzCodec: corrupt match");
+                }
+                std::size_t from = out.size() - offset;
+                for (std::size_t k = 0; k < matchLen; ++k) {
+                    out.push_back(out[from + k]); // matches may overlap themselves
+                }
+            }
+            if (out.size() != rawSize) throw std::runtime_error("LzCodec: size mismatch");
+            return out;
         }
 };
 
+// Scratch file for spilled mementos. Blobs are appended with pwrite and
+// read back through a read-only mapping of their pages; the caretaker
+// compacts it once more of it is dead than live. The file is unlinked as
+// soon as it is opened, so it never outlives the process.
+class SpillFile {
+    private:
+        int fd;
+        std::size_t end = 0;
+
+        void writeAt(const char* data, std::size_t len, std::size_t off) {
+            for (std::size_t done = 0; done < len;) {
+                ssize_t n = ::pwrite(fd, data + done, len - done, off_t(off + done));
+                if (n < 0) throw std::system_error(errno, std::generic_category(), "pwrite");
+                done += std::size_t(n);
+            }
+        }
+    public:
+        // Creates a fresh file named prefix-XXXXXX, so concurrent histories
+        // and processes never share one.
+        explicit SpillFile(const std::string& prefix) {
+            std::string path = prefix + "-XXXXXX";
+            fd = ::mkstemp(&path[0]);
+            if (fd < 0) throw std::system_error(errno, std::generic_category(), path);
+            ::unlink(path.c_str());
+        }
+        SpillFile(const SpillFile&) = delete;
+        SpillFile& operator=(const SpillFile&) = delete;
+        ~SpillFile() { ::close(fd); }
+
+        std::size_t size() const { return end; }
+
+        std::size_t append(const std::string& blob) {
+            std::size_t off = end;
+            writeAt(blob.data(), blob.size(), off);
+            end += blob.size();
+            return off;
+        }
+
+        std::string read(std::size_t off, std::size_t len) const {
+            if (!len) return {};
+            std::size_t page = std::size_t(::sysconf(_SC_PAGESIZE));
+            std::size_t start = off / page * page;
+            std::size_t span = off - start + len;
+            void* map = ::mmap(nullptr, span, PROT_READ, MAP_PRIVATE, fd, off_t(start));
+            if (map == MAP_FAILED) throw std::system_error(errno, std::generic_category(), "mmap");
+            std::string blob(static_cast<const char*>(map) + (off - start), len);
+            ::munmap(map, span);
+            return blob;
+        }
+
+        // Copies len bytes down to a lower offset, front to back, so the
+        // ranges may overlap.
+        void moveDown(std::size_t from, std::size_t to, std::size_t len) {
+            char buf[64 * 1024];
+            for (std::size_t done = 0; done < len;) {
+                ssize_t n = ::pread(fd, buf, std::min(sizeof buf, len - done), off_t(from + done));
+                if (n <= 0) throw std::system_error(n ? errno : EIO, std::generic_category(), "pread");
+                writeAt(buf, std::size_t(n), to + done);
+                done += std::size_t(n);
+            }
+        }
+
+        void truncate(std::size_t size) {
+            if (::ftruncate(fd, off_t(size)) == 0) end = size;
+        }
+};
+
+enum class Eviction {
+    DropOldest, // forget the oldest mementos first
+    Thin        // keep exponentially spaced checkpoints across the whole history
+};
+
+struct HistoryLimits {
+    std::size_t hotEntries = 16;                                   // newest mementos kept as-is
+    std::size_t memoryBudget = std::numeric_limits<std::size_t>::max(); // cold bytes kept in RAM
+    // All bytes, incl. spilled. Below one compressed full text of the
+    // document no cold history fits: each pass then keeps only the newest
+    // entry, and History::evicted() counts what went.
+    std::size_t totalBudget = std::numeric_limits<std::size_t>::max();
+    Eviction eviction = Eviction::DropOldest;
+    std::string spillPath;                                         // spill file prefix; empty: never spill
+};
+
+// Caretaker with a memory budget. The newest mementos stay hot; older ones
+// are compressed, then spilled to disk once the cold set outgrows the RAM
+// budget, and finally evicted when the whole history exceeds its limit.
+// A default-constructed History is unbounded, like the classic caretaker.
+//
+// A cold memento that follows the entry before it is stored as the edits
+// between the two, whether it was a delta or a checkpoint, so the history
+// holds one full text per run of entries. A run is closed, and the next cold
+// entry stored as a full text, once its deltas outweigh its full text, so
+// rebuilding any entry replays at most that much. A budget too small for two
+// full texts keeps a single run, whose deltas the budget bounds instead.
+//
+// Eviction goes down to 7/8 of the total budget in one pass so its cost is
+// shared by the entries it removes. Removing a full text turns the delta
+// after it into one, which costs a decompress, a replay and a compress and
+// frees nothing; a pass only does that if it frees a full text's worth
+// more than it must, and otherwise removes whole runs.
 class History {
     private:
-        std::vector<std::shared_ptr<Memento> > mementos; 
+        enum class Form {
+            Hot,         // the memento itself
+            Text,        // compressed full text
+            Edits,       // edits since the previous entry, encoded
+            PackedEdits  // the same, compressed
+        };
+
+        struct Entry {
+            std::uint64_t seq;
+            std::uint64_t id;     // memento identity, to spot a delta's base
+            std::uint64_t prevId;
+            Form form = Form::Hot;
+            std::shared_ptr<Memento> hot;
+            std::string cold;
+            bool spilled = false;
+            std::size_t spillOff = 0;
+            std::size_t bytes = 0;
+            // For a cold delta: delta bytes since its run's full text, itself
+            // included, and the size of that text. Only a guide to when to
+            // close the run, so evict() leaves later entries' counts be.
+            std::size_t runBytes = 0;
+            std::size_t baseBytes = 0;
+        };
+
+        HistoryLimits limits;
+        std::shared_ptr<const Codec> codec;
+        std::unique_ptr<SpillFile> spill;
+        std::deque<Entry> entries;
+        std::uint64_t nextSeq = 0;
+        std::size_t hotCount = 0;
+        std::size_t firstInMemory = 0; // entries before this index are spilled
+        std::size_t coldBytes = 0;
+        std::size_t spilledLive = 0;
+        std::size_t totalBytes = 0;
+        std::size_t evictedCount = 0;
+        std::size_t textRaw = 0;    // size of the last full text compressed,
+        std::size_t textPacked = 0; // before and after
+
+        static bool isDelta(const Entry& e) {
+            return e.form == Form::Edits || e.form == Form::PackedEdits;
+        }
+
+        std::string blobOf(const Entry& e) const {
+            return e.spilled ? spill->read(e.spillOff, e.bytes) : e.cold;
+        }
+
+        std::vector<Edit> editsOf(const Entry& e) const {
+            if (e.form == Form::Hot) return e.hot->changes();
+            std::string blob = blobOf(e);
+            if (e.form == Form::PackedEdits) blob = codec->decompress(blob.data(), blob.size());
+            return decodeEdits(blob);
+        }
+
+        // Rebuilds entry i from the nearest hot or full entry at or before it.
+        PieceTree textAt(std::size_t i) const {
+            std::size_t from = i;
+            while (isDelta(entries[from])) {
+                if (from == 0) throw std::logic_error("History: delta without a base");
+                --from;
+            }
+            PieceTree text;
+            if (entries[from].form == Form::Hot) {
+                text = entries[from].hot->getText();
+            } else {
+                std::string blob = blobOf(entries[from]);
+                text = PieceTree(codec->decompress(blob.data(), blob.size()));
+            }
+            for (std::size_t k = from + 1; k <= i; ++k) {
+                replay(text, editsOf(entries[k]));
+            }
+            return text;
+        }
+
+        // Drops whatever the entry holds from the byte counts.
+        void release(Entry& e) {
+            totalBytes -= e.bytes;
+            if (e.form == Form::Hot) {
+                --hotCount;
+            } else if (e.spilled) {
+                spilledLive -= e.bytes;
+            } else {
+                coldBytes -= e.bytes;
+            }
+            e.hot.reset();
+            std::string().swap(e.cold);
+            e.bytes = 0;
+        }
+
+        // Stores a cold form, in the spill file if the entry already lived there.
+        void place(Entry& e, Form form, std::string blob) {
+            bool toSpill = e.spilled;
+            release(e);
+            e.form = form;
+            e.bytes = blob.size();
+            totalBytes += e.bytes;
+            if (toSpill) {
+                e.spillOff = spill->append(blob);
+                spilledLive += e.bytes;
+            } else {
+                e.cold = std::move(blob);
+                coldBytes += e.bytes;
+            }
+        }
+
+        // Encoded edits, compressed only when that makes them smaller, so a
+        // cold delta never costs more than it did hot.
+        std::pair<Form, std::string> packEdits(const std::vector<Edit>& edits) const {
+            std::string raw = encodeEdits(edits);
+            std::string packed = codec->compress(raw);
+            if (packed.size() < raw.size()) {
+                return {Form::PackedEdits, std::move(packed)};
+            }
+            return {Form::Edits, std::move(raw)};
+        }
+
+        // Stores entry i as a delta on entry `base`, in base's run.
+        void placeEdits(std::size_t i, std::size_t base, std::pair<Form, std::string> packed) {
+            const Entry& prev = entries[base];
+            Entry& e = entries[i];
+            place(e, packed.first, std::move(packed.second));
+            e.runBytes = (isDelta(prev) ? prev.runBytes : 0) + e.bytes;
+            e.baseBytes = isDelta(prev) ? prev.baseBytes : prev.bytes;
+        }
+
+        void placeText(Entry& e, const std::string& text) {
+            std::string packed = codec->compress(text);
+            textRaw = text.size();
+            textPacked = packed.size();
+            place(e, Form::Text, std::move(packed));
+        }
+
+        // If entry i needs a full text that, going by the last one, would not
+        // fit in the total budget by itself, it and everything older are
+        // evicted instead of compressing a text only to drop it.
+        void cool(std::size_t i) {
+            Entry& e = entries[i];
+            if (i > 0 && entries[i - 1].id == e.prevId) {
+                const Entry& prev = entries[i - 1];
+                auto packed = packEdits(e.hot->changes());
+                std::size_t run = (isDelta(prev) ? prev.runBytes : 0) + packed.second.size();
+                std::size_t base = isDelta(prev) ? prev.baseBytes : prev.bytes;
+                if (run <= base || base > limits.totalBudget / 2) {
+                    placeEdits(i, i - 1, std::move(packed));
+                    return;
+                }
+            }
+            PieceTree text = e.hot->getText();
+            if (textRaw && double(text.size()) * double(textPacked) / double(textRaw) > double(limits.totalBudget)) {
+                std::vector<bool> doomed(entries.size(), false);
+                std::fill(doomed.begin(), doomed.begin() + std::ptrdiff_t(i) + 1, true);
+                evict(doomed);
+                return;
+            }
+            placeText(e, text.toString());
+        }
+
+        void spillOut(Entry& e) {
+            e.spillOff = spill->append(e.cold);
+            e.spilled = true;
+            coldBytes -= e.bytes;
+            spilledLive += e.bytes;
+            std::string().swap(e.cold);
+        }
+
+        // Removes the marked entries. A cold delta that loses its base is
+        // rebased first: onto the surviving entry before the removed run by
+        // prepending their edits, or, if a full text goes, into a full text.
+        // The oldest hot entry is rebased the same way, and so cooled early,
+        // when the cold entry it followed goes; otherwise it would have to
+        // be cooled into a full text.
+        void evict(const std::vector<bool>& doomed) {
+            for (std::size_t i = 0; i < entries.size();) {
+                if (!doomed[i]) {
+                    ++i;
+                    continue;
+                }
+                std::size_t first = i;
+                while (i < entries.size() && doomed[i]) ++i;
+                if (i == entries.size()) continue;
+                bool hotNext = entries[i].form == Form::Hot && entries[i].prevId == entries[i - 1].id;
+                if (!isDelta(entries[i]) && !hotNext) continue;
+                bool rebase = first > 0;
+                for (std::size_t k = first; rebase && k < i; ++k) {
+                    rebase = isDelta(entries[k]);
+                }
+                if (rebase) {
+                    std::vector<Edit> edits;
+                    for (std::size_t k = first; k <= i; ++k) {
+                        std::vector<Edit> more = editsOf(entries[k]);
+                        std::move(more.begin(), more.end(), std::back_inserter(edits));
+                    }
+                    placeEdits(i, first - 1, packEdits(edits));
+                } else if (!hotNext) {
+                    placeText(entries[i], textAt(i).toString());
+                }
+            }
+            std::deque<Entry> kept;
+            std::size_t spilledKept = 0;
+            for (std::size_t i = 0; i < entries.size(); ++i) {
+                if (doomed[i]) {
+                    release(entries[i]);
+                    ++evictedCount;
+                    continue;
+                }
+                if (i < firstInMemory) ++spilledKept;
+                kept.push_back(std::move(entries[i]));
+            }
+            entries.swap(kept);
+            firstInMemory = spilledKept;
+        }
+
+        // Marks the oldest entries, keeping the newest one. Stopping before a
+        // delta whose full text goes means rebuilding that text, so there the
+        // pass must have freed that much more; usually it runs on to the next
+        // full text instead and rebuilds nothing.
+        std::vector<bool> oldestVictims(std::size_t excess) const {
+            std::vector<bool> doomed(entries.size(), false);
+            std::size_t freed = 0;
+            std::size_t lostBase = 0;
+            for (std::size_t i = 0; i + 1 < entries.size(); ++i) {
+                bool orphan = isDelta(entries[i]);
+                if (freed >= excess + (orphan ? lostBase : 0)) break;
+                doomed[i] = true;
+                freed += entries[i].bytes;
+                if (!orphan) lostBase = entries[i].bytes;
+            }
+            return doomed;
+        }
+
+        // Marks the entries whose removal leaves the smallest gap relative to
+        // their age, never two neighbours in one pass since each removal
+        // widens its neighbours' gaps. Repeatedly dropping them converges on
+        // exponentially spaced checkpoints. Only cold entries are thinned;
+        // with none between the ends it falls back to the oldest.
+        std::vector<bool> thinningVictims(std::size_t excess) const {
+            std::size_t coldEnd = entries.size() - hotCount;
+            if (coldEnd < 2 || entries.size() < 3) {
+                return oldestVictims(excess);
+            }
+            std::vector<bool> doomed(entries.size(), false);
+            std::uint64_t newest = entries.back().seq;
+            std::vector<std::pair<double, std::size_t>> scores;
+            scores.reserve(coldEnd - 1);
+            for (std::size_t i = 1; i < coldEnd && i + 1 < entries.size(); ++i) {
+                double gap = double(entries[i + 1].seq - entries[i - 1].seq);
+                scores.emplace_back(gap / double(newest - entries[i].seq), i);
+            }
+            std::sort(scores.begin(), scores.end());
+            // A full text with a delta after it is only taken when nothing
+            // else is left, since removing it rebuilds one as large.
+            std::size_t freed = 0;
+            for (bool rebuild : {false, true}) {
+                for (const auto& [score, i] : scores) {
+                    if (freed >= excess) break;
+                    if (doomed[i] || doomed[i - 1] || doomed[i + 1]) continue;
+                    if (!rebuild && !isDelta(entries[i]) && (isDelta(entries[i + 1]) ||
+                            entries[i + 1].prevId == entries[i].id)) continue;
+                    doomed[i] = true;
+                    freed += entries[i].bytes;
+                }
+                if (freed) break;
+            }
+            return doomed;
+        }
+
+        // Packs live spilled blobs to the front of the file once it is more
+        // dead than live. Blobs only move down, so one forward pass does it.
+        void compactSpill() {
+            if (!spill) return;
+            std::size_t dead = spill->size() - spilledLive;
+            if (!spilledLive) {
+                if (dead) spill->truncate(0);
+                return;
+            }
+            if (dead <= spilledLive || dead < 4096) return;
+            std::vector<Entry*> live;
+            for (Entry& e : entries) {
+                if (e.spilled) live.push_back(&e);
+            }
+            std::sort(live.begin(), live.end(),
+                [](const Entry* a, const Entry* b) { return a->spillOff < b->spillOff; });
+            std::size_t to = 0;
+            for (Entry* e : live) {
+                if (e->spillOff != to) spill->moveDown(e->spillOff, to, e->bytes);
+                e->spillOff = to;
+                to += e->bytes;
+            }
+            spill->truncate(to);
+        }
+
+        void rebalance() {
+            while (hotCount > limits.hotEntries) {
+                cool(entries.size() - hotCount);
+            }
+            while (spill && coldBytes > limits.memoryBudget && firstInMemory < entries.size()
+                    && entries[firstInMemory].form != Form::Hot) {
+                spillOut(entries[firstInMemory++]);
+            }
+            std::size_t lowWater = limits.totalBudget - limits.totalBudget / 8;
+            while (totalBytes > limits.totalBudget && entries.size() > 1) {
+                std::size_t excess = totalBytes - lowWater;
+                evict(limits.eviction == Eviction::Thin ? thinningVictims(excess) : oldestVictims(excess));
+            }
+            compactSpill();
+        }
+
     public:
+        History() = default;
+        explicit History(HistoryLimits l,
+                std::shared_ptr<const Codec> c = std::make_shared<LzCodec>())
+            : limits(std::move(l)), codec(std::move(c)) {
+            if (!limits.spillPath.empty()) {
+                spill = std::make_unique<SpillFile>(limits.spillPath);
+            }
+        }
+
         void push(const std::shared_ptr<Memento>& m) {
-            mementos.push_back(m);
+            Entry e;
+            e.seq = nextSeq++;
+            e.id = m->identity();
+            e.prevId = m->previous();
+            e.hot = m;
+            bool follows = !entries.empty() && entries.back().id == e.prevId;
+            e.bytes = follows ? m->footprint() : m->getText().size();
+            totalBytes += e.bytes;
+            ++hotCount;
+            entries.push_back(std::move(e));
+            if (codec) rebalance();
         }
 
         std::shared_ptr<Memento> pop() {
-            if (mementos.empty()) return nullptr;
-            auto m = mementos.back();
-            mementos.pop_back();
+            if (entries.empty()) return nullptr;
+            std::size_t last = entries.size() - 1;
+            std::shared_ptr<Memento> m = entries[last].hot;
+            if (!m) {
+                m = std::make_shared<Memento>(textAt(last));
+            }
+            release(entries[last]);
+            entries.pop_back();
+            firstInMemory = std::min(firstInMemory, entries.size());
+            compactSpill();
             return m;
         }
+
+        std::size_t size() const { return entries.size(); }
+        std::size_t bytesInMemory() const { return totalBytes - spilledLive; }
+        std::size_t spilledBytes() const { return spilledLive; }
+        std::size_t evicted() const { return evictedCount; }
  };
 
- int main () {
+struct SnapshotInfo {
+    std::string path;
+    std::size_t rawBytes;
+    std::size_t storedBytes;
+};
+
+// Persists snapshots on a background thread. The editing thread only hands
+// over an O(1) piece tree view; flattening, compression and the write to
+// disk happen on the writer's thread. Pending snapshots are drained on
+// destruction.
+class SnapshotWriter {
+    private:
+        struct Job {
+            PieceTree text;
+            std::promise<SnapshotInfo> done;
+        };
+
+        std::string dir;
+        std::shared_ptr<const Codec> codec;
+        std::mutex mtx;
+        std::condition_variable cv;
+        std::deque<Job> jobs;
+        std::uint64_t nextId = 0;
+        // Distinguishes this writer's files from earlier runs and other writers.
+        std::string tag = std::to_string(std::chrono::system_clock::now().time_since_epoch().count())
+            + "-" + std::to_string(::getpid()) + "-" + std::to_string(writerSerial()++);
+        bool stopping = false;
+        std::thread worker;
+
+        static std::atomic<std::uint64_t>& writerSerial() {
+            static std::atomic<std::uint64_t> serial{0};
+            return serial;
+        }
+
+        void run() {
+            for (;;) {
+                Job job;
+                {
+                    std::unique_lock<std::mutex> lock(mtx);
+                    cv.wait(lock, [this] { return stopping || !jobs.empty(); });
+                    if (jobs.empty()) return;
+                    job = std::move(jobs.front());
+                    jobs.pop_front();
+                }
+                try {
+                    job.done.set_value(writeNow(job.text));
+                } catch (...) {
+                    job.done.set_exception(std::current_exception());
+                }
+            }
+        }
+
+    public:
+        explicit SnapshotWriter(std::string d,
+                std::shared_ptr<const Codec> c = std::make_shared<LzCodec>())
+            : dir(std::move(d)), codec(std::move(c)), worker([this] { run(); }) {}
+
+        SnapshotWriter(const SnapshotWriter&) = delete;
+        SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+
+        ~SnapshotWriter() {
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                stopping = true;
+            }
+            cv.notify_one();
+            worker.join();
+        }
+
+        std::future<SnapshotInfo> submit(PieceTree text) {
+            Job job{std::move(text), {}};
+            std::future<SnapshotInfo> result = job.done.get_future();
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                jobs.push_back(std::move(job));
+            }
+            cv.notify_one();
+            return result;
+        }
+
+        // Serializes, compresses and durably writes a snapshot on the
+        // calling thread: into a temporary file that is synced, renamed over
+        // the final name, and made durable by syncing the directory. Names
+        // carry the time, process and writer, so writers never collide.
+        SnapshotInfo writeNow(const PieceTree& text) {
+            std::uint64_t id;
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                id = nextId++;
+            }
+            std::string raw = text.toString();
+            std::string blob = codec->compress(raw);
+            std::string path = dir + "/snapshot-" + tag + "-" + std::to_string(id) + ".lz";
+            std::string temp = path + ".tmp";
+
+            auto fail = [](const std::string& what) {
+                throw std::system_error(errno, std::generic_category(), what);
+            };
+            int fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+            if (fd < 0) fail(temp);
+            try {
+                for (std::size_t done = 0; done < blob.size();) {
+                    ssize_t n = ::write(fd, blob.data() + done, blob.size() - done);
+                    if (n < 0) fail(temp);
+                    done += std::size_t(n);
+                }
+                if (::fsync(fd) != 0) fail(temp);
+                int closed = ::close(fd);
+                fd = -1;
+                if (closed != 0) fail(temp);
+                if (::rename(temp.c_str(), path.c_str()) != 0) fail(path);
+            } catch (...) {
+                if (fd >= 0) ::close(fd);
+                ::unlink(temp.c_str());
+                throw;
+            }
+            int dirFd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+            if (dirFd < 0) fail(dir);
+            int synced = ::fsync(dirFd);
+            int err = errno;
+            ::close(dirFd);
+            if (synced != 0) throw std::system_error(err, std::generic_category(), dir);
+            return {path, raw.size(), blob.size()};
+        }
+
+        // Throws if the file cannot be read or does not hold a valid snapshot.
+        std::shared_ptr<Memento> load(const std::string& path) const {
+            std::ifstream in(path, std::ios::binary);
+            if (!in) throw std::runtime_error("cannot open snapshot " + path);
+            std::string blob((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+            if (in.bad()) throw std::runtime_error("cannot read snapshot " + path);
+            return std::make_shared<Memento>(codec->decompress(blob.data(), blob.size()));
+        }
+};
+
+// Edit and snapshot latency on a large buffer: a std::string document
+// (insert in the middle, snapshot by copy) against the piece tree.
+void runBenchmark(std::size_t bytes) {
+    using Clock = std::chrono::steady_clock;
+    const int rounds = 20;
+    auto micros = [](Clock::duration d) {
+        return std::chrono::duration<double, std::micro>(d).count();
+    };
+
+    std::string flat(bytes, 'x');
+    Clock::duration flatEdit{}, flatSnap{};
+    for (int i = 0; i < rounds; ++i) {
+        auto t0 = Clock::now();
+        flat.insert(flat.size() / 2, "edit");
+        auto t1 = Clock::now();
+        std::string snapshot = flat;
+        auto t2 = Clock::now();
+        flatEdit += t1 - t0;
+        flatSnap += t2 - t1;
+    }
+
+    TextEditor editor;
+    editor.type(std::string(bytes, 'x'));
+    History history;
+    Clock::duration treeEdit{}, treeSnap{};
+    for (int i = 0; i < rounds; ++i) {
+        auto t0 = Clock::now();
+        editor.insert(editor.size() / 2, "edit");
+        auto t1 = Clock::now();
+        history.push(editor.save());
+        auto t2 = Clock::now();
+        treeEdit += t1 - t0;
+        treeSnap += t2 - t1;
+    }
+
+    std::cout << "Buffer: " << (bytes >> 20) << " MB, " << rounds << " rounds\n"
+        << "std::string  edit " << micros(flatEdit) / rounds << " us, snapshot "
+        << micros(flatSnap) / rounds << " us\n"
+        << "PieceTree    edit " << micros(treeEdit) / rounds << " us, snapshot "
+        << micros(treeSnap) / rounds << " us" << std::endl;
+}
+
+// p50/p99 edit latency while snapshots are taken every few thousand edits:
+// not at all, synchronously on the editing thread, and in the background.
+void runSnapshotLatencyBenchmark(std::size_t bytes) {
+    using Clock = std::chrono::steady_clock;
+    const int edits = 100000;
+    const int snapshotEvery = 10000;
+    std::string dir = std::filesystem::temp_directory_path().string();
+
+    auto measure = [&](const char* label, int mode) {
+        TextEditor editor;
+        editor.type(std::string(bytes, 'x'));
+        SnapshotWriter writer(dir);
+        std::vector<std::future<SnapshotInfo>> pending;
+        std::vector<std::string> written;
+        std::vector<double> latencies;
+        latencies.reserve(edits);
+        std::mt19937 rng(42);
+        for (int i = 1; i <= edits; ++i) {
+            auto t0 = Clock::now();
+            editor.insert(rng() % editor.size(), "edit");
+            if (i % snapshotEvery == 0 && mode == 1) {
+                written.push_back(writer.writeNow(editor.snapshot()).path);
+            } else if (i % snapshotEvery == 0 && mode == 2) {
+                pending.push_back(writer.submit(editor.snapshot()));
+            }
+            latencies.push_back(std::chrono::duration<double, std::micro>(Clock::now() - t0).count());
+        }
+        for (auto& f : pending) {
+            written.push_back(f.get().path);
+        }
+        for (const auto& path : written) {
+            std::remove(path.c_str());
+        }
+        std::sort(latencies.begin(), latencies.end());
+        std::cout << label << " p50 " << latencies[latencies.size() / 2] << " us, p99 "
+            << latencies[latencies.size() * 99 / 100] << " us, p99.9 "
+            << latencies[latencies.size() * 999 / 1000] << " us, max "
+            << latencies.back() << " us" << std::endl;
+    };
+
+    std::cout << "Edit latency on " << (bytes >> 20) << " MB, snapshot every "
+        << snapshotEvery << " edits" << std::endl;
+    measure("No snapshots   ", 0);
+    measure("Sync snapshots ", 1);
+    measure("Async snapshots", 2);
+}
+
+ int main (int argc, char* argv[]) {
+    if (argc > 1 && std::string(argv[1]) == "bench") {
+        runBenchmark(std::size_t(100) << 20);
+        runSnapshotLatencyBenchmark(std::size_t(100) << 20);
+        return 0;
+    }
+
     TextEditor editor;
     History history;
 
@@ -93,5 +1259,58 @@ class History {
     editor.restore(history.pop());
     std::cout << "After second undo: " << editor.getText() << std::endl;
 
+    // Delta mementos: a checkpoint every 4 saves, deltas in between.
+    TextEditor deltaEditor(4);
+    History deltaHistory;
+
+    deltaEditor.type("Hello World!");
+    deltaHistory.push(deltaEditor.save());
+
+    deltaEditor.insert(5, ",");
+    deltaHistory.push(deltaEditor.save());
+
+    deltaEditor.erase(6, 7);
+    deltaEditor.type(" there!");
+    deltaHistory.push(deltaEditor.save());
+
+    std::cout << "Delta state: " << deltaEditor.getText() << std::endl;
+
+    deltaEditor.restore(deltaHistory.pop());
+    deltaEditor.restore(deltaHistory.pop());
+    std::cout << "After delta undo: " << deltaEditor.getText() << std::endl;
+
+    deltaEditor.restore(deltaHistory.pop());
+    std::cout << "After checkpoint undo: " << deltaEditor.getText() << std::endl;
+
+    // Bounded history: two hot mementos, older ones compressed, then spilled.
+    HistoryLimits limits;
+    limits.hotEntries = 2;
+    limits.memoryBudget = 128;
+    limits.spillPath = (std::filesystem::temp_directory_path() / "memento_spill").string();
+    History bounded(limits);
+    TextEditor logEditor;
+    for (int i = 1; i <= 6; ++i) {
+        logEditor.type("Line " + std::to_string(i) + " of a long and repetitive document.\n");
+        bounded.push(logEditor.save());
+    }
+    std::cout << "Bounded history: " << bounded.size() << " mementos, "
+        << bounded.bytesInMemory() << " bytes in memory, "
+        << bounded.spilledBytes() << " bytes spilled" << std::endl;
+    while (bounded.size() > 1) {
+        bounded.pop();
+    }
+    logEditor.restore(bounded.pop());
+    std::cout << "Oldest memento: " << logEditor.getText();
+
+    // Async snapshot: the editor keeps typing while the writer persists it.
+    SnapshotWriter writer(std::filesystem::temp_directory_path().string());
+    std::future<SnapshotInfo> pending = writer.submit(logEditor.snapshot());
+    logEditor.type("Typed while the snapshot was written.\n");
+    SnapshotInfo info = pending.get();
+    logEditor.restore(writer.load(info.path));
+    std::remove(info.path.c_str());
+    std::cout << "Async snapshot: " << info.rawBytes << " bytes, restored: "
+        << logEditor.getText();
+
     return 0;
  }
\ No newline at end of file
@@ -15,6 +15,26 @@
 #include <iostream>
 #include <memory>
 #include <string>
+#include <unordered_map>
+#include <list>
+#include <mutex>
+#include <future>
+#include <functional>
+#include <filesystem>
+#include <cstdint>
+#include <chrono>
+#include <thread>
+#include <deque>
+#include <vector>
+#include <condition_variable>
+#include <algorithm>
+#include <system_error>
+#include <fstream>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 // Subject
 class Image {
@@ -23,30 +43,329 @@ class Image {
         virtual ~Image() = default;
 };
 
+// Read-only view over bytes that something else owns.
+struct ByteSpan {
+    const unsigned char* data = nullptr;
+    std::size_t size = 0;
+};
+
+// The bytes of one image file. Large files are mapped and exposed in place,
+// small ones are read with pread into a buffer (a mapping costs a page-table
+// setup and at least a whole page). Every open of the same path while a
+// previous ImageData is still alive returns that same object, so proxies
+// that display one file share its pages.
+class ImageData {
+    public:
+        enum class Access { Sequential, WillNeed };
+
+        static constexpr std::size_t kMapThreshold = std::size_t(64) << 10;
+
+        static std::shared_ptr<const ImageData> open(const std::string& path,
+            Access access = Access::Sequential) {
+            static std::mutex mutex;
+            static std::unordered_map<std::string, std::weak_ptr<const ImageData>> live;
+            static std::size_t sweepAt = 64;
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (auto existing = live[path].lock()) {
+                return existing;
+            }
+            std::shared_ptr<const ImageData> data(new ImageData(path, access));
+            live[path] = data;
+            // Other paths' expired entries are dropped once the map has
+            // doubled since the last sweep, so an open costs O(1) amortized.
+            if (live.size() >= sweepAt) {
+                for (auto it = live.begin(); it != live.end();) {
+                    it = it->second.expired() ? live.erase(it) : std::next(it);
+                }
+                sweepAt = std::max<std::size_t>(64, 2 * live.size());
+            }
+            return data;
+        }
+
+        ImageData(const ImageData&) = delete;
+        ImageData& operator=(const ImageData&) = delete;
+
+        ~ImageData() {
+            if (mapping) {
+                ::munmap(mapping, length);
+            }
+        }
+
+        ByteSpan bytes() const {
+            if (mapping) {
+                return {static_cast<const unsigned char*>(mapping), length};
+            }
+            return {buffer.data(), buffer.size()};
+        }
+        bool mapped() const { return mapping != nullptr; }
+
+    private:
+        void* mapping = nullptr;
+        std::size_t length = 0;
+        std::vector<unsigned char> buffer;
+
+        ImageData(const std::string& path, Access access) {
+            int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0) {
+                throw std::system_error(errno, std::generic_category(), "open " + path);
+            }
+            struct FdCloser {
+                int fd;
+                ~FdCloser() { ::close(fd); }
+            } closer{fd};
+
+            struct stat st;
+            if (::fstat(fd, &st) != 0) {
+                throw std::system_error(errno, std::generic_category(), "fstat " + path);
+            }
+            length = std::size_t(st.st_size);
+
+            if (length >= kMapThreshold) {
+                mapping = ::mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+                if (mapping == MAP_FAILED) {
+                    mapping = nullptr;
+                    throw std::system_error(errno, std::generic_category(), "mmap " + path);
+                }
+                ::madvise(mapping, length,
+                    access == Access::Sequential ? MADV_SEQUENTIAL : MADV_WILLNEED);
+                return;
+            }
+
+            buffer.resize(length);
+            std::size_t done = 0;
+            while (done < length) {
+                ssize_t n = ::pread(fd, buffer.data() + done, length - done, off_t(done));
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (n < 0) {
+                    throw std::system_error(errno, std::generic_category(), "pread " + path);
+                }
+                if (n == 0) {
+                    break; // file shrank underneath us
+                }
+                done += std::size_t(n);
+            }
+            buffer.resize(done);
+            length = done;
+        }
+};
+
 class RealImage : public Image {
     std::string filename;
+    std::shared_ptr<const ImageData> data;
+    std::size_t sizeBytes = 0;
 public :
     RealImage(const std::string& fname) : filename(fname) {
-        loadFromDisk(filename);
+        loadFromDisk();
     }
 
-    void loadFromDisk() const {
+    void loadFromDisk() {
         std::cout << "Loading image " << filename << std::endl;
+        // Images that are not on disk are modelled as 1 MB each.
+        std::error_code ec;
+        if (!std::filesystem::is_regular_file(filename, ec)) {
+            sizeBytes = std::size_t(1) << 20;
+            return;
+        }
+        data = ImageData::open(filename);
+        sizeBytes = data->bytes().size;
     }
     void display() const override {
         std::cout << "Display Image " << filename << std::endl; 
     }
+
+    std::size_t bytes() const { return sizeBytes; }
+    // Empty for images that are not on disk.
+    ByteSpan pixels() const { return data ? data->bytes() : ByteSpan{}; }
+};
+
+// Background I/O threads that run image loads. Queued loads are finished
+// before the pool is destroyed, so it must go before any cache it feeds.
+class LoaderPool {
+        std::mutex mtx;
+        std::condition_variable cv;
+        std::deque<std::function<void()>> tasks;
+        bool stopping = false;
+        std::vector<std::thread> threads;
+
+        void work() {
+            for (;;) {
+                std::function<void()> task;
+                {
+                    std::unique_lock<std::mutex> lock(mtx);
+                    cv.wait(lock, [this] { return stopping || !tasks.empty(); });
+                    if (tasks.empty()) return;
+                    task = std::move(tasks.front());
+                    tasks.pop_front();
+                }
+                task();
+            }
+        }
+
+    public:
+        explicit LoaderPool(unsigned n = 4) {
+            for (unsigned i = 0; i < n; ++i) {
+                threads.emplace_back([this] { work(); });
+            }
+        }
+
+        ~LoaderPool() {
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                stopping = true;
+            }
+            cv.notify_all();
+            for (auto& t : threads) {
+                t.join();
+            }
+        }
+
+        void submit(std::function<void()> task) {
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                tasks.push_back(std::move(task));
+            }
+            cv.notify_one();
+        }
+};
+
+// Shared, size-bounded cache of loaded images, keyed by filename, so that
+// separate proxies for the same file share one RealImage. Least recently
+// used images are evicted once the loaded bytes exceed the budget; proxies
+// still displaying an evicted image keep it alive until they are done.
+// Loads are single-flight: concurrent first requests for a file wait on
+// the one load in progress instead of starting their own.
+class ImageCache {
+    public:
+        using ImagePtr = std::shared_ptr<const RealImage>;
+        using Loader = std::function<ImagePtr(const std::string&)>;
+
+        struct Stats {
+            std::uint64_t hits = 0;
+            std::uint64_t misses = 0;
+            std::uint64_t evictions = 0;
+            std::size_t bytes = 0;
+            std::size_t entries = 0;
+        };
+
+        explicit ImageCache(std::size_t byteBudget,
+                Loader loader = [](const std::string& f) { return std::make_shared<const RealImage>(f); })
+            : budget(byteBudget), loader(std::move(loader)) {}
+
+        ImagePtr get(const std::string& filename) {
+            std::shared_ptr<std::promise<ImagePtr>> load;
+            std::shared_future<ImagePtr> image = lookup(filename, load);
+            if (load) {
+                complete(filename, *load);
+            }
+            return image.get();
+        }
+
+        // Like get(), but a miss is loaded on the pool and the caller gets a
+        // future for it straight away.
+        std::shared_future<ImagePtr> getAsync(const std::string& filename, LoaderPool& pool) {
+            std::shared_ptr<std::promise<ImagePtr>> load;
+            std::shared_future<ImagePtr> image = lookup(filename, load);
+            if (load) {
+                pool.submit([this, filename, load] { complete(filename, *load); });
+            }
+            return image;
+        }
+
+        Stats stats() const {
+            std::lock_guard<std::mutex> lock(mtx);
+            Stats s = counters;
+            s.entries = entries.size();
+            return s;
+        }
+
+    private:
+        struct Entry {
+            std::shared_future<ImagePtr> image;
+            std::list<std::string>::iterator recent;
+            std::size_t bytes = 0;
+            bool ready = false;
+        };
+
+        std::size_t budget;
+        Loader loader;
+        mutable std::mutex mtx;
+        std::unordered_map<std::string, Entry> entries;
+        std::list<std::string> recency; // most recently used first
+        Stats counters;
+
+        // Returns the entry's future. On a miss, load is set and the caller
+        // is responsible for completing it.
+        std::shared_future<ImagePtr> lookup(const std::string& filename,
+                std::shared_ptr<std::promise<ImagePtr>>& load) {
+            std::lock_guard<std::mutex> lock(mtx);
+            auto it = entries.find(filename);
+            if (it != entries.end()) {
+                ++counters.hits;
+                recency.splice(recency.begin(), recency, it->second.recent);
+                return it->second.image;
+            }
+            ++counters.misses;
+            load = std::make_shared<std::promise<ImagePtr>>();
+            recency.push_front(filename);
+            Entry& entry = entries[filename];
+            entry.image = load->get_future().share();
+            entry.recent = recency.begin();
+            return entry.image;
+        }
+
+        void complete(const std::string& filename, std::promise<ImagePtr>& load) {
+            ImagePtr image;
+            try {
+                image = loader(filename);
+            } catch (...) {
+                load.set_exception(std::current_exception());
+                std::lock_guard<std::mutex> lock(mtx);
+                auto it = entries.find(filename);
+                recency.erase(it->second.recent);
+                entries.erase(it); // let a later request retry
+                return;
+            }
+            load.set_value(image);
+
+            std::lock_guard<std::mutex> lock(mtx);
+            Entry& entry = entries[filename];
+            entry.ready = true;
+            entry.bytes = image->bytes();
+            counters.bytes += entry.bytes;
+            evict(filename);
+        }
+
+        void evict(const std::string& keep) {
+            auto it = recency.end();
+            while (counters.bytes > budget && it != recency.begin()) {
+                --it;
+                auto entry = entries.find(*it);
+                if (!entry->second.ready || *it == keep) continue;
+                counters.bytes -= entry->second.bytes;
+                ++counters.evictions;
+                entries.erase(entry);
+                it = recency.erase(it);
+            }
+        }
 };
 
 // Proxy 
 class ProxyImage : public Image {
     std::string filename;
     mutable std::unique_ptr<RealImage> realImage;
+    std::shared_ptr<ImageCache> cache;
     public:
-        ProxyImage(const std::string& fname) : 
-            filename(fname), realImage(nullptr) {}
+        ProxyImage(const std::string& fname, std::shared_ptr<ImageCache> cache = nullptr) : 
+            filename(fname), realImage(nullptr), cache(std::move(cache)) {}
 
         void display() const override {
+            if (cache) {
+                cache->get(filename)->display();
+                return;
+            }
             if (!realImage) {
                 realImage = std::make_unique<RealImage>(filename);
             }
@@ -54,8 +373,197 @@ class ProxyImage : public Image {
         }
 };
 
-int main() 
+// Asynchronous virtual proxy. The load starts on prefetch() or the first
+// display() and runs on the loader pool. display() waits for the image up to
+// a deadline and otherwise renders a placeholder, so a slow disk never
+// stalls the caller for long. Once shown, the proxy lets go of the image
+// and leaves its lifetime to the cache's budget.
+class AsyncProxyImage : public Image {
+    std::string filename;
+    std::shared_ptr<ImageCache> cache;
+    LoaderPool& pool;
+    std::chrono::milliseconds deadline;
+    mutable std::shared_future<ImageCache::ImagePtr> pending;
+
+    public:
+        enum class State { Placeholder, Loading, Ready, Failed };
+
+        AsyncProxyImage(const std::string& fname, std::shared_ptr<ImageCache> cache,
+                LoaderPool& pool, std::chrono::milliseconds deadline = std::chrono::milliseconds(50))
+            : filename(fname), cache(std::move(cache)), pool(pool), deadline(deadline) {}
+
+        void prefetch() const {
+            if (!pending.valid()) {
+                pending = cache->getAsync(filename, pool);
+            }
+        }
+
+        State state() const {
+            if (!pending.valid()) return State::Placeholder;
+            if (pending.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+                return State::Loading;
+            }
+            try {
+                pending.get();
+                return State::Ready;
+            } catch (...) {
+                return State::Failed;
+            }
+        }
+
+        void display() const override {
+            displayWithin(deadline);
+        }
+
+        // Returns true if the real image was shown, false for the placeholder.
+        bool displayWithin(std::chrono::milliseconds wait) const {
+            prefetch();
+            if (pending.wait_for(wait) != std::future_status::ready) {
+                std::cout << "Display placeholder for " << filename << std::endl;
+                return false;
+            }
+            std::shared_future<ImageCache::ImagePtr> done = std::move(pending);
+            pending = {};
+            try {
+                done.get()->display();
+                return true;
+            } catch (const std::exception& e) {
+                std::cout << "Display broken image for " << filename << ": " << e.what() << std::endl;
+                return false;
+            }
+        }
+};
+
+// Learns the stride of recent accesses (1 when scrolling forward, -1 when
+// scrolling back, larger when paging) and, once it repeats, predicts the
+// next few indices to prefetch.
+class SequentialPrefetcher {
+    long last = -1;
+    long stride = 0;
+    int confidence = 0;
+    std::size_t depth;
+
+    public:
+        explicit SequentialPrefetcher(std::size_t depth = 3) : depth(depth) {}
+
+        std::vector<std::size_t> record(std::size_t index, std::size_t count) {
+            long current = long(index);
+            long step = current - last;
+            if (last >= 0 && step != 0 && step == stride) {
+                ++confidence;
+            } else {
+                stride = last >= 0 ? step : 0;
+                confidence = 0;
+            }
+            last = current;
+
+            std::vector<std::size_t> predicted;
+            if (confidence < 1) return predicted;
+            for (std::size_t i = 1; i <= depth; ++i) {
+                long next = current + stride * long(i);
+                if (next < 0 || next >= long(count)) break;
+                predicted.push_back(std::size_t(next));
+            }
+            return predicted;
+        }
+};
+
+// A scrollable set of async proxies that prefetches ahead of the reader.
+class Gallery {
+    std::vector<AsyncProxyImage> images;
+    SequentialPrefetcher prefetcher;
+    std::size_t readyWhenShown = 0;
+
+    public:
+        Gallery(const std::vector<std::string>& files, std::shared_ptr<ImageCache> cache,
+                LoaderPool& pool) {
+            for (const auto& f : files) {
+                images.emplace_back(f, cache, pool);
+            }
+        }
+
+        bool show(std::size_t index) {
+            for (std::size_t next : prefetcher.record(index, images.size())) {
+                images[next].prefetch();
+            }
+            const AsyncProxyImage& image = images[index];
+            readyWhenShown += image.state() == AsyncProxyImage::State::Ready;
+            return image.displayWithin(std::chrono::milliseconds(50));
+        }
+
+        // Images that were already loaded by the time they were shown.
+        std::size_t prefetchHits() const { return readyWhenShown; }
+};
+
+// Writes a file of `size` pseudo-random bytes for the demo and benchmark.
+void writeSampleFile(const std::string& path, std::size_t size) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    std::vector<char> chunk(std::size_t(1) << 20);
+    std::uint32_t x = 2463534242u;
+    for (char& c : chunk) {
+        x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+        c = char(x);
+    }
+    for (std::size_t written = 0; written < size; written += chunk.size()) {
+        out.write(chunk.data(), std::streamsize(std::min(chunk.size(), size - written)));
+    }
+}
+
+std::uint64_t checksum(const unsigned char* p, std::size_t n) {
+    std::uint64_t sum = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+        sum += p[i];
+    }
+    return sum;
+}
+
+// Reads a large file end to end with ifstream and with ImageData, touching
+// every byte either way. Runs each twice and keeps the warm (page cache)
+// timing, which is where the copy ifstream makes shows up.
+void runLoaderBenchmark(std::size_t size) {
+    std::string path = (std::filesystem::temp_directory_path() / "proxy_bench.img").string();
+    writeSampleFile(path, size);
+    using Clock = std::chrono::steady_clock;
+    auto ms = [](Clock::duration d) {
+        return std::chrono::duration<double, std::milli>(d).count();
+    };
+
+    double streamMs = 0, mapMs = 0;
+    std::uint64_t streamSum = 0, mapSum = 0;
+    for (int round = 0; round < 2; ++round) {
+        auto start = Clock::now();
+        {
+            std::ifstream in(path, std::ios::binary);
+            std::unique_ptr<unsigned char[]> buffer(new unsigned char[size]); // not zero-filled
+            in.read(reinterpret_cast<char*>(buffer.get()), std::streamsize(size));
+            streamSum = checksum(buffer.get(), std::size_t(in.gcount()));
+        }
+        streamMs = ms(Clock::now() - start);
+
+        start = Clock::now();
+        {
+            auto data = ImageData::open(path);
+            ByteSpan span = data->bytes();
+            mapSum = checksum(span.data, span.size);
+        }
+        mapMs = ms(Clock::now() - start);
+    }
+    std::filesystem::remove(path);
+
+    std::cout << "Read " << (size >> 20) << " MB: ifstream " << streamMs << " ms, mmap "
+        << mapMs << " ms" << (streamSum == mapSum ? "" : " (checksum mismatch!)") << std::endl;
+}
+
+// How to compile - g++ -std=c++17 -pthread proxy_pattern.cpp
+// Run "./a.out bench" to compare mapped loading with ifstream.
+
+int main(int argc, char* argv[]) 
 {
+    if (argc > 1 && std::string(argv[1]) == "bench") {
+        runLoaderBenchmark(std::size_t(512) << 20);
+        return 0;
+    }
+
     Image *img1 = new ProxyImage("photo1.jpg");
     Image *img2 = new ProxyImage("photo2.jpg");
 
@@ -67,5 +575,43 @@ int main()
     delete img1;
     delete img2;
 
+    std::cout << "\n--- Shared cache (2 MB budget) ---\n";
+    auto cache = std::make_shared<ImageCache>(std::size_t(2) << 20);
+    ProxyImage a("photo1.jpg", cache), b("photo1.jpg", cache), c("photo2.jpg", cache),
+        d("photo3.jpg", cache);
+    a.display();
+    b.display(); // same file, no second load
+    c.display();
+    d.display(); // evicts photo1.jpg
+    a.display(); // loads it again
+
+    ImageCache::Stats stats = cache->stats();
+    std::cout << "Hits: " << stats.hits << ", misses: " << stats.misses
+        << ", evictions: " << stats.evictions << ", cached: " << stats.entries << std::endl;
+
+    std::cout << "\n--- Async gallery with prefetching ---\n";
+    auto galleryCache = std::make_shared<ImageCache>(std::size_t(16) << 20);
+    {
+        LoaderPool pool(2);
+        Gallery gallery({"g0.jpg", "g1.jpg", "g2.jpg", "g3.jpg", "g4.jpg", "g5.jpg"},
+            galleryCache, pool);
+        for (std::size_t i = 0; i < 6; ++i) {
+            gallery.show(i);
+            std::this_thread::sleep_for(std::chrono::milliseconds(20)); // reading time
+        }
+        std::cout << "Shown without waiting: " << gallery.prefetchHits() << " of 6" << std::endl;
+    }
+
+    std::cout << "\n--- Mapped files ---\n";
+    std::string sample = (std::filesystem::temp_directory_path() / "proxy_demo.img").string();
+    writeSampleFile(sample, std::size_t(1) << 20);
+    {
+        RealImage first(sample), second(sample);
+        std::cout << "Mapped: " << (ImageData::open(sample)->mapped() ? "yes" : "no")
+            << ", pages shared: " << (first.pixels().data == second.pixels().data ? "yes" : "no")
+            << std::endl;
+    }
+    std::filesystem::remove(sample);
+
     return 0;    
 }
\ No newline at end of file